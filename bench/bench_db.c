@@ -0,0 +1,522 @@
+// bench_db.c - In-process microbenchmarks for the Mini-Redis database engine
+// This file links src/database.c directly and measures per-operation throughput
+// and cache misses for db_set/db_get/db_delete/db_cleanup without any networking.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <json-c/json.h>
+#include "database.h"
+#include "config.h"
+
+// Number of operations timed together; keys and values for a batch are
+// prepared outside the measured region
+#define BENCH_BATCH 4096
+#define MAX_LIST 16
+
+// Storage engine under test. New engines register an entry in `engines`
+// so their results can be compared side by side with the AVL tree.
+typedef struct
+{
+    const char *name;
+    void (*init)(void);
+    int (*set)(const char *key, json_object *value);
+    json_object *(*get)(const char *key);
+    int (*del)(const char *key);
+    void (*cleanup)(void);
+} BenchEngine;
+
+// AVL tree without and with the negative-lookup key filter
+static void avl_init(void)
+{
+    db_init();
+    db_disable_filter();
+}
+
+static void filter_init(void)
+{
+    db_init();
+    db_enable_filter(KEY_FILTER_CAPACITY);
+}
+
+static const BenchEngine engines[] = {
+    {"avl", avl_init, db_set, db_get, db_delete, db_cleanup},
+    {"filter", filter_init, db_set, db_get, db_delete, db_cleanup},
+};
+
+// Result of one measured phase
+typedef struct
+{
+    unsigned long long ops;
+    double seconds;
+    long long cache_misses;
+} PhaseResult;
+
+// Benchmark configuration, filled from the command line
+static unsigned long long key_counts[MAX_LIST] = {1000, 10000, 100000, 1000000};
+static int num_key_counts = 4;
+static int key_lengths[MAX_LIST] = {16, 64};
+static int num_key_lengths = 2;
+static int orders[2] = {0, 1}; // 0 = sequential, 1 = random
+static int num_orders = 2;
+static const char *engine_names[MAX_LIST] = {"avl"};
+static int num_engines = 1;
+static int value_size = 32;
+static const char *allocator = NULL;
+static int csv_output = 0;
+static unsigned int seed = 42;
+
+static int perf_fd = -1;
+
+// Open a hardware cache-miss counter for this thread, if the kernel allows it
+static void perf_open(void)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (perf_fd == -1)
+    {
+        fprintf(stderr, "perf_event_open unavailable (%s), cache misses will not be reported\n", strerror(errno));
+    }
+}
+
+static void perf_start(void)
+{
+    if (perf_fd != -1)
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+static void perf_stop(void)
+{
+    if (perf_fd != -1)
+        ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+}
+
+// Read and reset the counter
+static long long perf_read(void)
+{
+    long long count = -1;
+    if (perf_fd == -1)
+        return -1;
+    if (read(perf_fd, &count, sizeof(count)) != sizeof(count))
+        return -1;
+    ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+    return count;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Resident set size in bytes, used to compare allocators
+static size_t rss_bytes(void)
+{
+    unsigned long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL)
+        return 0;
+    if (fscanf(f, "%lu %lu", &pages, &resident) != 2)
+        resident = 0;
+    fclose(f);
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// Build the key for index i. Keys are a fixed-width hex number right-aligned
+// behind a shared filler prefix, so strcmp order matches numeric order and
+// comparisons get more expensive as the key length grows.
+static void make_key(char *out, int key_len, unsigned long long i)
+{
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%016llx", i);
+    int fill = key_len - n;
+
+    if (fill < 0)
+    {
+        memcpy(out, digits - fill, key_len);
+    }
+    else
+    {
+        memset(out, 'k', fill);
+        memcpy(out + fill, digits, n);
+    }
+    out[key_len] = '\0';
+}
+
+// Fisher-Yates shuffle of the insert order
+static void shuffle(uint32_t *order, unsigned long long n)
+{
+    for (unsigned long long i = n - 1; i > 0; i--)
+    {
+        unsigned long long j = (((unsigned long long)rand_r(&seed) << 31) ^ rand_r(&seed)) % (i + 1);
+        uint32_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+// Stored keys use even numbers and miss keys the odd numbers between them,
+// so misses walk the full depth of the index instead of falling off one edge
+static unsigned long long key_index(const uint32_t *order, unsigned long long i, int miss)
+{
+    return 2 * (order ? order[i] : i) + miss;
+}
+
+// Time set operations over all n keys
+static PhaseResult run_set(const BenchEngine *engine, unsigned long long n, int key_len,
+                           const uint32_t *order, char *keys, json_object **values, const char *payload)
+{
+    PhaseResult result = {n, 0, 0};
+
+    for (unsigned long long base = 0; base < n; base += BENCH_BATCH)
+    {
+        int batch = (n - base < BENCH_BATCH) ? (int)(n - base) : BENCH_BATCH;
+        for (int i = 0; i < batch; i++)
+        {
+            make_key(keys + i * (key_len + 1), key_len, key_index(order, base + i, 0));
+            values[i] = json_object_new_string(payload);
+        }
+
+        double start = now_seconds();
+        perf_start();
+        for (int i = 0; i < batch; i++)
+            engine->set(keys + i * (key_len + 1), values[i]);
+        perf_stop();
+        result.seconds += now_seconds() - start;
+        result.cache_misses += perf_read();
+    }
+    return result;
+}
+
+// Time get operations for n stored keys, or n absent keys when `miss` is set
+static PhaseResult run_get(const BenchEngine *engine, unsigned long long n, int miss,
+                           int key_len, const uint32_t *order, char *keys, unsigned long long *found)
+{
+    PhaseResult result = {n, 0, 0};
+
+    for (unsigned long long base = 0; base < n; base += BENCH_BATCH)
+    {
+        int batch = (n - base < BENCH_BATCH) ? (int)(n - base) : BENCH_BATCH;
+        for (int i = 0; i < batch; i++)
+            make_key(keys + i * (key_len + 1), key_len, key_index(order, base + i, miss));
+
+        double start = now_seconds();
+        perf_start();
+        for (int i = 0; i < batch; i++)
+        {
+            if (engine->get(keys + i * (key_len + 1)) != NULL)
+                (*found)++;
+        }
+        perf_stop();
+        result.seconds += now_seconds() - start;
+        result.cache_misses += perf_read();
+    }
+    return result;
+}
+
+// Time delete operations for the first n keys of the insert order
+static PhaseResult run_delete(const BenchEngine *engine, unsigned long long n, int key_len,
+                              const uint32_t *order, char *keys)
+{
+    PhaseResult result = {n, 0, 0};
+
+    for (unsigned long long base = 0; base < n; base += BENCH_BATCH)
+    {
+        int batch = (n - base < BENCH_BATCH) ? (int)(n - base) : BENCH_BATCH;
+        for (int i = 0; i < batch; i++)
+            make_key(keys + i * (key_len + 1), key_len, key_index(order, base + i, 0));
+
+        double start = now_seconds();
+        perf_start();
+        for (int i = 0; i < batch; i++)
+            engine->del(keys + i * (key_len + 1));
+        perf_stop();
+        result.seconds += now_seconds() - start;
+        result.cache_misses += perf_read();
+    }
+    return result;
+}
+
+// Time freeing whatever is left in the database
+static PhaseResult run_cleanup(const BenchEngine *engine, unsigned long long remaining)
+{
+    PhaseResult result = {remaining, 0, 0};
+    double start = now_seconds();
+    perf_start();
+    engine->cleanup();
+    perf_stop();
+    result.seconds = now_seconds() - start;
+    result.cache_misses = perf_read();
+    return result;
+}
+
+static void print_header(void)
+{
+    if (csv_output)
+    {
+        printf("engine,allocator,keys,key_len,order,op,ops,ns_per_op,mops_per_sec,cache_misses_per_op,rss_mb\n");
+    }
+    else
+    {
+        printf("%-6s %-10s %10s %5s %-4s %-8s %10s %10s %12s %8s\n",
+               "engine", "allocator", "keys", "klen", "ord", "op", "ns/op", "Mops/s", "misses/op", "rss MB");
+    }
+}
+
+static void print_result(const char *engine, unsigned long long n, int key_len, int random_order,
+                         const char *op, PhaseResult r, size_t rss)
+{
+    double ns_per_op = r.ops ? r.seconds * 1e9 / r.ops : 0;
+    double mops = r.seconds > 0 ? r.ops / r.seconds / 1e6 : 0;
+    double misses = (perf_fd != -1 && r.ops) ? (double)r.cache_misses / r.ops : -1;
+    const char *ord = random_order ? "rand" : "seq";
+
+    if (csv_output)
+    {
+        printf("%s,%s,%llu,%d,%s,%s,%llu,%.1f,%.3f,", engine, allocator, n, key_len, ord, op, r.ops, ns_per_op, mops);
+        if (misses >= 0)
+            printf("%.2f", misses);
+        printf(",%.1f\n", rss / 1048576.0);
+    }
+    else
+    {
+        printf("%-6s %-10s %10llu %5d %-4s %-8s %10.1f %10.3f ", engine, allocator, n, key_len, ord, op, ns_per_op, mops);
+        if (misses >= 0)
+            printf("%12.2f", misses);
+        else
+            printf("%12s", "n/a");
+        printf(" %8.1f\n", rss / 1048576.0);
+    }
+    fflush(stdout);
+}
+
+// Run every phase for a single configuration
+static void run_config(const BenchEngine *engine, unsigned long long n, int key_len, int random_order,
+                       char *keys, json_object **values, const char *payload)
+{
+    uint32_t *order = NULL;
+    unsigned long long found = 0;
+
+    // Stored and miss keys together span 2n indexes, which must fit in key_len hex digits
+    if (key_len < 16 && (2 * n - 1) >> (4 * key_len) != 0)
+    {
+        fprintf(stderr, "Skipping %llu keys of length %d: key length too short\n", n, key_len);
+        return;
+    }
+
+    if (random_order)
+    {
+        order = (uint32_t *)malloc(n * sizeof(uint32_t));
+        if (order == NULL)
+        {
+            fprintf(stderr, "Out of memory for %llu keys\n", n);
+            return;
+        }
+        for (unsigned long long i = 0; i < n; i++)
+            order[i] = (uint32_t)i;
+        shuffle(order, n);
+    }
+
+    engine->init();
+
+    PhaseResult r = run_set(engine, n, key_len, order, keys, values, payload);
+    size_t rss = rss_bytes();
+    print_result(engine->name, n, key_len, random_order, "set", r, rss);
+
+    r = run_get(engine, n, 0, key_len, order, keys, &found);
+    print_result(engine->name, n, key_len, random_order, "get_hit", r, rss);
+
+    r = run_get(engine, n, 1, key_len, order, keys, &found);
+    print_result(engine->name, n, key_len, random_order, "get_miss", r, rss);
+
+    if (found != n)
+        fprintf(stderr, "Warning: expected %llu hits, got %llu\n", n, found);
+
+    r = run_delete(engine, n / 2, key_len, order, keys);
+    print_result(engine->name, n, key_len, random_order, "delete", r, rss_bytes());
+
+    r = run_cleanup(engine, n - n / 2);
+    print_result(engine->name, n, key_len, random_order, "cleanup", r, rss_bytes());
+
+    free(order);
+}
+
+// Parse a count such as 1000, 10K or 100M
+static unsigned long long parse_count(const char *s)
+{
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (*end == 'K' || *end == 'k')
+        v *= 1000ULL;
+    else if (*end == 'M' || *end == 'm')
+        v *= 1000000ULL;
+    return v;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-n counts] [-k key_lengths] [-o seq,rand] [-e engines] [-v value_size] [-a allocator] [-s seed] [-c]\n"
+            "  -n  comma separated key counts, e.g. 1K,100K,10M,100M (default 1K,10K,100K,1M)\n"
+            "  -k  comma separated key lengths, max %d (default 16,64)\n"
+            "  -o  insert orders: seq, rand or seq,rand (default seq,rand)\n"
+            "  -e  storage engines to compare (available: avl,filter)\n"
+            "  -v  value size in bytes (default 32)\n"
+            "  -a  allocator label for the report (default: from LD_PRELOAD, else glibc)\n"
+            "  -s  random seed (default 42)\n"
+            "  -c  CSV output\n",
+            prog, MAX_KEY_SIZE - 1);
+    exit(EXIT_FAILURE);
+}
+
+static void parse_arguments(int argc, char *argv[])
+{
+    int opt;
+    char *tok;
+
+    while ((opt = getopt(argc, argv, "n:k:o:e:v:a:s:c")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            num_key_counts = 0;
+            for (tok = strtok(optarg, ","); tok && num_key_counts < MAX_LIST; tok = strtok(NULL, ","))
+                key_counts[num_key_counts++] = parse_count(tok);
+            break;
+        case 'k':
+            num_key_lengths = 0;
+            for (tok = strtok(optarg, ","); tok && num_key_lengths < MAX_LIST; tok = strtok(NULL, ","))
+                key_lengths[num_key_lengths++] = atoi(tok);
+            break;
+        case 'o':
+            num_orders = 0;
+            for (tok = strtok(optarg, ","); tok && num_orders < 2; tok = strtok(NULL, ","))
+                orders[num_orders++] = strncmp(tok, "rand", 4) == 0;
+            break;
+        case 'e':
+            num_engines = 0;
+            for (tok = strtok(optarg, ","); tok && num_engines < MAX_LIST; tok = strtok(NULL, ","))
+                engine_names[num_engines++] = tok;
+            break;
+        case 'v':
+            value_size = atoi(optarg);
+            break;
+        case 'a':
+            allocator = optarg;
+            break;
+        case 's':
+            seed = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            csv_output = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    for (int i = 0; i < num_key_lengths; i++)
+    {
+        if (key_lengths[i] < 1 || key_lengths[i] > MAX_KEY_SIZE - 1)
+        {
+            fprintf(stderr, "Key length must be between 1 and %d\n", MAX_KEY_SIZE - 1);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < num_key_counts; i++)
+    {
+        if (key_counts[i] == 0 || key_counts[i] > UINT32_MAX)
+        {
+            fprintf(stderr, "Key count must be between 1 and %u\n", UINT32_MAX);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static const BenchEngine *find_engine(const char *name)
+{
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++)
+    {
+        if (strcmp(engines[i].name, name) == 0)
+            return &engines[i];
+    }
+    return NULL;
+}
+
+// Derive the allocator label from LD_PRELOAD, e.g. libjemalloc.so.2 -> jemalloc
+static const char *detect_allocator(void)
+{
+    static char label[64];
+    const char *preload = getenv("LD_PRELOAD");
+    if (preload == NULL || *preload == '\0')
+        return "glibc";
+
+    const char *base = strrchr(preload, '/');
+    base = base ? base + 1 : preload;
+    if (strncmp(base, "lib", 3) == 0)
+        base += 3;
+    snprintf(label, sizeof(label), "%s", base);
+    label[strcspn(label, ".")] = '\0';
+    return label;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_arguments(argc, argv);
+    if (allocator == NULL)
+        allocator = detect_allocator();
+
+    // Keys in a batch are padded to the longest configured length
+    char *keys = (char *)malloc((size_t)BENCH_BATCH * MAX_KEY_SIZE);
+    json_object **values = (json_object **)malloc(BENCH_BATCH * sizeof(json_object *));
+    char *payload = (char *)malloc(value_size + 1);
+    if (keys == NULL || values == NULL || payload == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    memset(payload, 'v', value_size);
+    payload[value_size] = '\0';
+
+    perf_open();
+    print_header();
+
+    for (int e = 0; e < num_engines; e++)
+    {
+        const BenchEngine *engine = find_engine(engine_names[e]);
+        if (engine == NULL)
+        {
+            fprintf(stderr, "Unknown engine: %s\n", engine_names[e]);
+            continue;
+        }
+        for (int c = 0; c < num_key_counts; c++)
+            for (int k = 0; k < num_key_lengths; k++)
+                for (int o = 0; o < num_orders; o++)
+                    run_config(engine, key_counts[c], key_lengths[k], orders[o], keys, values, payload);
+    }
+
+    if (perf_fd != -1)
+        close(perf_fd);
+    free(payload);
+    free(values);
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,592 @@
+// bench_net.c - Network benchmarks for the Mini-Redis project
+// This file drives a running server through libminiredis and reports SET and
+// GET throughput for blocking, pipelined, batched and event-loop clients
+// sharing a connection pool.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include "miniredis.h"
+
+#define MAX_LIST 16
+#define KEY_LEN 32
+
+enum
+{
+    OP_SET,
+    OP_GET
+};
+
+// One measured phase: `op` on keys [0, keys) from `clients` connections with
+// up to `depth` commands per round trip
+typedef struct
+{
+    int op;
+    unsigned long long keys;
+    int clients;
+    int depth;
+} BenchRun;
+
+// Replies of one client. SETs count a hit per OK, GETs per value that
+// matches what was stored.
+typedef struct
+{
+    int op;
+    unsigned long long hits;
+    unsigned long long in_flight;
+} Counter;
+
+// Client access pattern under test. New modes register an entry in `modes`
+// so their results can be compared side by side.
+typedef struct
+{
+    const char *name;
+    int (*run)(const BenchRun *run, unsigned long long *hits);
+} BenchMode;
+
+// Benchmark configuration, filled from the command line
+static const char *host = "127.0.0.1";
+static int port = 45234;
+static unsigned long long key_count = 100000;
+static int client_counts[MAX_LIST] = {1, 4};
+static int num_client_counts = 2;
+static int depths[MAX_LIST] = {1, 16, 128};
+static int num_depths = 3;
+static const char *mode_names[MAX_LIST] = {"sync", "pipeline", "batch", "async"};
+static int num_modes = 4;
+static int value_size = 32;
+static int csv_output = 0;
+
+static char *payload;
+static MiniRedisPool *pool;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Keys are fixed width, so every run sends the same number of bytes per key
+static void make_key(char *out, unsigned long long i)
+{
+    snprintf(out, KEY_LEN, "bench:%016llx", i);
+}
+
+// Count the lines of a reply that succeeded
+static void count_reply(MiniRedis *conn, const MiniRedisReply *reply, void *ctx)
+{
+    (void)conn;
+    Counter *counter = (Counter *)ctx;
+    counter->in_flight--;
+    if (reply == NULL)
+        return;
+
+    for (size_t i = 0; i < reply->count; i++)
+    {
+        const char *line = reply->lines[i];
+        size_t len = reply->lengths[i];
+        if (counter->op == OP_SET)
+            counter->hits += (len == 2 && memcmp(line, "OK", 2) == 0);
+        else
+            counter->hits += (len == (size_t)value_size + 2 && memcmp(line + 1, payload, value_size) == 0);
+    }
+}
+
+// A thread's share of the keys, on a connection from the pool
+typedef struct
+{
+    const BenchRun *run;
+    int (*range)(MiniRedis *conn, const BenchRun *run, unsigned long long first, unsigned long long count,
+                 unsigned long long *hits);
+    unsigned long long first;
+    unsigned long long count;
+    unsigned long long hits;
+    int rc;
+} Worker;
+
+// Split the keys between the clients; the last one takes the remainder
+static void client_share(const BenchRun *run, int client, unsigned long long *first, unsigned long long *count)
+{
+    unsigned long long share = run->keys / run->clients;
+    *first = share * client;
+    *count = (client == run->clients - 1) ? run->keys - *first : share;
+}
+
+// One blocking call per key
+static int sync_range(MiniRedis *conn, const BenchRun *run, unsigned long long first, unsigned long long count,
+                      unsigned long long *hits)
+{
+    char key[KEY_LEN];
+    for (unsigned long long i = first; i < first + count; i++)
+    {
+        make_key(key, i);
+        if (run->op == OP_SET)
+        {
+            if (miniredis_set(conn, key, payload) < 0)
+                return -1;
+            (*hits)++;
+        }
+        else
+        {
+            char *value = NULL;
+            int found = miniredis_get(conn, key, &value, NULL);
+            if (found < 0)
+                return -1;
+            *hits += (found == 1 && strcmp(value, payload) == 0);
+            free(value);
+        }
+    }
+    return 0;
+}
+
+// `depth` commands submitted, then one wait for all their replies
+static int pipeline_range(MiniRedis *conn, const BenchRun *run, unsigned long long first, unsigned long long count,
+                          unsigned long long *hits)
+{
+    char key[KEY_LEN];
+    Counter counter = {run->op, 0, 0};
+    for (unsigned long long i = first; i < first + count;)
+    {
+        for (int d = 0; d < run->depth && i < first + count; d++, i++)
+        {
+            make_key(key, i);
+            int rc = run->op == OP_SET ? miniredis_submit_set(conn, key, payload, value_size, count_reply, &counter)
+                                       : miniredis_submit_get(conn, key, count_reply, &counter);
+            if (rc < 0)
+            {
+                // Commands already queued call back into `counter`, so
+                // collect their replies before it goes out of scope
+                miniredis_wait(conn);
+                return -1;
+            }
+            counter.in_flight++;
+        }
+        if (miniredis_wait(conn) < 0)
+            return -1;
+    }
+    *hits = counter.hits;
+    return 0;
+}
+
+// One MSET or MGET of `depth` keys per round trip
+static int batch_range(MiniRedis *conn, const BenchRun *run, unsigned long long first, unsigned long long count,
+                       unsigned long long *hits)
+{
+    char (*keys)[KEY_LEN] = malloc((size_t)run->depth * KEY_LEN);
+    const char **key_ptrs = malloc(run->depth * sizeof(char *));
+    const char **value_ptrs = malloc(run->depth * sizeof(char *));
+    char **values = malloc(run->depth * sizeof(char *));
+    int rc = (keys && key_ptrs && value_ptrs && values) ? 0 : -1;
+
+    for (unsigned long long i = first; i < first + count && rc == 0;)
+    {
+        size_t n = 0;
+        for (; n < (size_t)run->depth && i < first + count; n++, i++)
+        {
+            make_key(keys[n], i);
+            key_ptrs[n] = keys[n];
+            value_ptrs[n] = payload;
+        }
+        if (run->op == OP_SET)
+        {
+            rc = miniredis_mset(conn, key_ptrs, value_ptrs, n);
+            if (rc == 0)
+                *hits += n;
+        }
+        else if ((rc = miniredis_mget(conn, key_ptrs, n, values)) == 0)
+        {
+            for (size_t j = 0; j < n; j++)
+            {
+                *hits += (values[j] && strcmp(values[j], payload) == 0);
+                free(values[j]);
+            }
+        }
+    }
+    free(values);
+    free(value_ptrs);
+    free(key_ptrs);
+    free(keys);
+    return rc;
+}
+
+static void *worker_main(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+    MiniRedis *conn = miniredis_pool_acquire(pool);
+    if (conn == NULL)
+    {
+        fprintf(stderr, "Cannot connect to %s:%d: %s\n", host, port, strerror(errno));
+        worker->rc = -1;
+        return NULL;
+    }
+    worker->rc = worker->range(conn, worker->run, worker->first, worker->count, &worker->hits);
+    miniredis_pool_release(pool, conn);
+    return NULL;
+}
+
+// Run `range` on a thread per client
+static int run_threads(const BenchRun *run, unsigned long long *hits,
+                       int (*range)(MiniRedis *, const BenchRun *, unsigned long long, unsigned long long,
+                                    unsigned long long *))
+{
+    Worker workers[run->clients];
+    pthread_t threads[run->clients];
+    int rc = 0;
+
+    for (int c = 0; c < run->clients; c++)
+    {
+        workers[c] = (Worker){run, range, 0, 0, 0, 0};
+        client_share(run, c, &workers[c].first, &workers[c].count);
+        if (pthread_create(&threads[c], NULL, worker_main, &workers[c]) != 0)
+        {
+            workers[c].rc = -1;
+            threads[c] = 0;
+        }
+    }
+    for (int c = 0; c < run->clients; c++)
+    {
+        if (threads[c])
+            pthread_join(threads[c], NULL);
+        *hits += workers[c].hits;
+        rc |= workers[c].rc;
+    }
+    return rc;
+}
+
+static int sync_run(const BenchRun *run, unsigned long long *hits)
+{
+    return run_threads(run, hits, sync_range);
+}
+
+static int pipeline_run(const BenchRun *run, unsigned long long *hits)
+{
+    return run_threads(run, hits, pipeline_range);
+}
+
+static int batch_run(const BenchRun *run, unsigned long long *hits)
+{
+    return run_threads(run, hits, batch_range);
+}
+
+// A connection driven by the epoll loop, keeping `depth` commands in flight
+typedef struct
+{
+    MiniRedis *conn;
+    Counter counter;
+    const BenchRun *run;
+    unsigned long long next;
+    unsigned long long end;
+    int epfd;
+} AsyncClient;
+
+// Watch for writability only while commands are queued
+static void async_write_hook(MiniRedis *conn, int want_write, void *data)
+{
+    AsyncClient *client = (AsyncClient *)data;
+    struct epoll_event ev = {.events = EPOLLIN | (want_write ? EPOLLOUT : 0), .data.ptr = client};
+    epoll_ctl(client->epfd, EPOLL_CTL_MOD, miniredis_fd(conn), &ev);
+}
+
+static void async_reply(MiniRedis *conn, const MiniRedisReply *reply, void *ctx);
+
+// Submit commands until `depth` are in flight
+static void async_refill(AsyncClient *client)
+{
+    char key[KEY_LEN];
+    while (client->counter.in_flight < (unsigned long long)client->run->depth && client->next < client->end)
+    {
+        make_key(key, client->next);
+        int rc = client->run->op == OP_SET
+                     ? miniredis_submit_set(client->conn, key, payload, value_size, async_reply, client)
+                     : miniredis_submit_get(client->conn, key, async_reply, client);
+        if (rc < 0)
+            return;
+        client->next++;
+        client->counter.in_flight++;
+    }
+}
+
+static void async_reply(MiniRedis *conn, const MiniRedisReply *reply, void *ctx)
+{
+    AsyncClient *client = (AsyncClient *)ctx;
+    count_reply(conn, reply, &client->counter);
+    if (reply)
+        async_refill(client);
+}
+
+// All clients on one thread, multiplexed with epoll through the event loop hooks
+static int async_run(const BenchRun *run, unsigned long long *hits)
+{
+    AsyncClient clients[run->clients];
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    int acquired = 0, active = 0, rc = 0;
+    if (epfd < 0)
+        return -1;
+
+    for (; acquired < run->clients; acquired++)
+    {
+        AsyncClient *client = &clients[acquired];
+        memset(client, 0, sizeof(*client));
+        client->conn = miniredis_pool_acquire(pool);
+        if (client->conn == NULL)
+        {
+            fprintf(stderr, "Cannot connect to %s:%d: %s\n", host, port, strerror(errno));
+            rc = -1;
+            break;
+        }
+        unsigned long long count;
+        client_share(run, acquired, &client->next, &count);
+        client->end = client->next + count;
+        client->counter.op = run->op;
+        client->run = run;
+        client->epfd = epfd;
+
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = client};
+        epoll_ctl(epfd, EPOLL_CTL_ADD, miniredis_fd(client->conn), &ev);
+        miniredis_set_write_hook(client->conn, async_write_hook, client);
+        async_refill(client);
+        active++;
+    }
+
+    while (rc == 0 && active > 0)
+    {
+        struct epoll_event events[64];
+        int n = epoll_wait(epfd, events, 64, -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            rc = -1;
+            break;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            AsyncClient *client = (AsyncClient *)events[i].data.ptr;
+            if ((events[i].events & EPOLLOUT) && miniredis_on_writable(client->conn) < 0)
+                rc = -1;
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && miniredis_on_readable(client->conn) < 0)
+                rc = -1;
+        }
+        active = 0;
+        for (int c = 0; c < acquired; c++)
+            active += clients[c].counter.in_flight > 0 || clients[c].next < clients[c].end;
+    }
+
+    for (int c = 0; c < acquired; c++)
+    {
+        *hits += clients[c].counter.hits;
+        epoll_ctl(epfd, EPOLL_CTL_DEL, miniredis_fd(clients[c].conn), NULL);
+        miniredis_pool_release(pool, clients[c].conn);
+    }
+    close(epfd);
+    return rc;
+}
+
+static const BenchMode modes[] = {
+    {"sync", sync_run},
+    {"pipeline", pipeline_run},
+    {"batch", batch_run},
+    {"async", async_run},
+};
+
+static void print_header(void)
+{
+    if (csv_output)
+        printf("mode,clients,depth,op,ops,ns_per_op,kops_per_sec\n");
+    else
+        printf("%-8s %7s %5s %-3s %10s %10s %10s\n", "mode", "clients", "depth", "op", "ops", "ns/op", "Kops/s");
+}
+
+static void print_result(const char *mode, const BenchRun *run, double seconds)
+{
+    const char *op = run->op == OP_SET ? "set" : "get";
+    double ns_per_op = seconds * 1e9 / run->keys;
+    double kops = seconds > 0 ? run->keys / seconds / 1e3 : 0;
+
+    if (csv_output)
+        printf("%s,%d,%d,%s,%llu,%.1f,%.1f\n", mode, run->clients, run->depth, op, run->keys, ns_per_op, kops);
+    else
+        printf("%-8s %7d %5d %-3s %10llu %10.1f %10.1f\n", mode, run->clients, run->depth, op, run->keys, ns_per_op,
+               kops);
+    fflush(stdout);
+}
+
+// Time SET then GET of every key
+// Returns: 0 if every reply was as expected, -1 otherwise
+static int run_config(const BenchMode *mode, int clients, int depth)
+{
+    for (int op = OP_SET; op <= OP_GET; op++)
+    {
+        BenchRun run = {op, key_count, clients, depth};
+        unsigned long long hits = 0;
+        double start = now_seconds();
+        int rc = mode->run(&run, &hits);
+        double seconds = now_seconds() - start;
+
+        if (rc < 0)
+        {
+            fprintf(stderr, "%s: connection failed: %s\n", mode->name, strerror(errno));
+            return -1;
+        }
+        print_result(mode->name, &run, seconds);
+        if (hits != key_count)
+        {
+            fprintf(stderr, "%s: expected %llu good replies, got %llu\n", mode->name, key_count, hits);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Parse a count such as 1000, 10K or 1M
+static unsigned long long parse_count(const char *s)
+{
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (*end == 'K' || *end == 'k')
+        v *= 1000ULL;
+    else if (*end == 'M' || *end == 'm')
+        v *= 1000000ULL;
+    return v;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-h host] [-p port] [-n keys] [-t clients] [-d depths] [-m modes] [-v value_size] [-c]\n"
+            "  -h  server host (default 127.0.0.1)\n"
+            "  -p  server port (default 45234)\n"
+            "  -n  keys to SET and then GET per run, e.g. 10K or 1M (default 100K)\n"
+            "  -t  comma separated client connection counts (default 1,4)\n"
+            "  -d  comma separated commands per round trip (default 1,16,128)\n"
+            "  -m  client modes to compare (available: sync,pipeline,batch,async)\n"
+            "  -v  value size in bytes (default 32)\n"
+            "  -c  CSV output\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+static void parse_arguments(int argc, char *argv[])
+{
+    int opt;
+    char *tok;
+
+    while ((opt = getopt(argc, argv, "h:p:n:t:d:m:v:c")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            host = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            key_count = parse_count(optarg);
+            break;
+        case 't':
+            num_client_counts = 0;
+            for (tok = strtok(optarg, ","); tok && num_client_counts < MAX_LIST; tok = strtok(NULL, ","))
+                client_counts[num_client_counts++] = atoi(tok);
+            break;
+        case 'd':
+            num_depths = 0;
+            for (tok = strtok(optarg, ","); tok && num_depths < MAX_LIST; tok = strtok(NULL, ","))
+                depths[num_depths++] = atoi(tok);
+            break;
+        case 'm':
+            num_modes = 0;
+            for (tok = strtok(optarg, ","); tok && num_modes < MAX_LIST; tok = strtok(NULL, ","))
+                mode_names[num_modes++] = tok;
+            break;
+        case 'v':
+            value_size = atoi(optarg);
+            break;
+        case 'c':
+            csv_output = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (key_count == 0 || value_size < 0)
+        usage(argv[0]);
+    for (int i = 0; i < num_client_counts; i++)
+    {
+        if (client_counts[i] < 1 || (unsigned long long)client_counts[i] > key_count)
+        {
+            fprintf(stderr, "Client count must be between 1 and the number of keys\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < num_depths; i++)
+    {
+        if (depths[i] < 1)
+        {
+            fprintf(stderr, "Depth must be at least 1\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static const BenchMode *find_mode(const char *name)
+{
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        if (strcmp(modes[i].name, name) == 0)
+            return &modes[i];
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_arguments(argc, argv);
+
+    int max_clients = 0;
+    for (int i = 0; i < num_client_counts; i++)
+        max_clients = client_counts[i] > max_clients ? client_counts[i] : max_clients;
+
+    // Connections persist in the pool from one run to the next
+    pool = miniredis_pool_create(host, port, max_clients);
+    payload = (char *)malloc(value_size + 1);
+    if (pool == NULL || payload == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    memset(payload, 'v', value_size);
+    payload[value_size] = '\0';
+
+    print_header();
+    int status = 0;
+    for (int m = 0; m < num_modes && status == 0; m++)
+    {
+        const BenchMode *mode = find_mode(mode_names[m]);
+        if (mode == NULL)
+        {
+            fprintf(stderr, "Unknown mode: %s\n", mode_names[m]);
+            continue;
+        }
+        for (int c = 0; c < num_client_counts && status == 0; c++)
+        {
+            // Blocking calls make one round trip per key whatever the depth
+            int runs = mode->run == sync_run ? 1 : num_depths;
+            for (int d = 0; d < runs && status == 0; d++)
+                status = run_config(mode, client_counts[c], mode->run == sync_run ? 1 : depths[d]);
+        }
+    }
+
+    miniredis_pool_destroy(pool);
+    free(payload);
+    return status ? 1 : 0;
+}
@@ -14,6 +14,8 @@ typedef struct
 
 void buffer_init(CircularBuffer *buf, size_t size);
 void buffer_write(CircularBuffer *buf, const char *data);
+void buffer_write_len(CircularBuffer *buf, const char *data, size_t len);
 void buffer_read(CircularBuffer *buf, char *output, size_t len);
+size_t buffer_peek(const CircularBuffer *buf, size_t skip, char *output, size_t len);
 
 #endif // CIRCULAR_BUFFER_H
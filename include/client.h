@@ -0,0 +1,73 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <stddef.h>
+#include <json-c/json.h>
+#include "reply.h"
+
+// Client flags
+#define CLIENT_CLOSE_AFTER_REPLY 0x1 // Close once queued output has been written
+#define CLIENT_CLOSING 0x2           // Closed by the server, waiting on in-flight I/O
+#define CLIENT_CLOSED 0x4            // Socket closed, freed once the backend is done with it
+#define CLIENT_PUBSUB_QUEUED 0x8     // Received messages in the publish being fanned out
+#define CLIENT_REPLICA 0x10          // A replica receiving the replication stream
+#define CLIENT_MASTER 0x20           // This node's link to the primary it replicates
+#define CLIENT_MULTI 0x40            // Queueing commands between MULTI and EXEC
+#define CLIENT_DIRTY_CAS 0x80        // A watched key changed, so EXEC aborts
+#define CLIENT_DIRTY_EXEC 0x100      // A command failed to queue, so EXEC aborts
+#define CLIENT_READ_PAUSED 0x200     // Too much output is unsent, commands are not read
+
+// A persistent client connection. Commands are parsed incrementally from
+// whatever the socket delivers, and replies accumulate in `out` until the
+// network backend writes them.
+typedef struct Client
+{
+    int fd;
+    int flags;
+    json_tokener *tok;
+    size_t request_bytes; // Bytes of the command currently being parsed
+    size_t command_bytes; // Wire size of the command being executed
+    ReplyQueue out;
+    void *backend;        // Per-connection state owned by the network backend
+    struct PubsubSubscription *subscriptions; // Channels and patterns, managed by pubsub.c
+    size_t subscription_count;
+    json_object *multi_commands;    // Commands queued since MULTI
+    struct ClientWatch *watched;    // Keys watched for EXEC, managed by multi.c
+    struct ReplSnapshot *snapshot;  // Full sync being sent to a replica, managed by repl.c
+    struct Client *prev;
+    struct Client *next;
+} Client;
+
+// Create a client for a connected socket and add it to the client list
+// Returns: Client* on success, NULL on allocation failure
+Client *client_create(int fd);
+
+// Remove a client from the client list and free it. The socket is not closed.
+void client_free(Client *client);
+
+// Feed received bytes to a client, executing every complete command
+// Returns: 0 to keep the connection, -1 if it must be closed
+int client_feed(Client *client, const char *data, size_t len);
+
+// Whether the client has output waiting to be written
+int client_has_output(const Client *client);
+
+// Queue more output for a client whose output is produced as it drains,
+// such as a replica being sent a snapshot. Backends call this whenever the
+// client's queued output has all been written.
+// Returns: 1 if output was queued, 0 if there is no more
+int client_refill(Client *client);
+
+// Whether the backend should read more commands from the client. Reading
+// stops once unsent output passes CLIENT_OUTPUT_HIGH_WATER and resumes when
+// it drains below CLIENT_OUTPUT_LOW_WATER, so a client that pipelines
+// without reading its replies cannot grow them without bound.
+int client_can_read(Client *client);
+
+// Queue an error reply and close the connection once it has been written
+void client_fail(Client *client, const char *message);
+
+// Free every client and close their sockets, used at shutdown
+void client_free_all(void);
+
+#endif // CLIENT_H
@@ -3,7 +3,21 @@
 
 #define PORT 45234
 #define MAX_PORT_TRIES 10
-#define BUFFER_SIZE 1024
+#define BUFFER_SIZE (64 * 1024) // Bytes read from a client socket at a time
 #define MAX_KEY_SIZE 256
+#define KEY_FILTER_CAPACITY (64 * 1024) // Keys the negative-lookup filter starts out sized for
+#define MAX_REQUEST_SIZE (64 * 1024 * 1024) // Largest JSON command accepted from a client
+#define CLIENT_OUTPUT_HIGH_WATER (4 * 1024 * 1024) // Unsent reply bytes at which a client's commands stop being read
+#define CLIENT_OUTPUT_LOW_WATER (1024 * 1024)      // Unsent reply bytes below which reading resumes
+#define ZEROCOPY_THRESHOLD (64 * 1024)      // Replies at least this large use MSG_ZEROCOPY (0 disables)
+#define ZEROCOPY_TIMEOUT 30                 // Seconds to wait for zerocopy completions before aborting
+#define REPL_BACKLOG_SIZE (1024 * 1024)       // Replication stream kept for partial resyncs
+#define REPL_OUTPUT_LIMIT (64 * 1024 * 1024)  // Unsent bytes a replica may fall behind by before it must resync
+#define REPL_SNAPSHOT_CHUNK (256 * 1024)      // Snapshot bytes queued for a replica each time its output drains
+#define REPL_RETRY_INTERVAL 1                 // Seconds between attempts to reach the primary
+#define PUBSUB_OUTPUT_LIMIT (32 * 1024 * 1024) // Unsent bytes a subscriber may fall behind by (0 disables)
+#define LAZYFREE_THRESHOLD (64 * 1024) // Values at least this large are freed in the background by UNLINK
+#define SCAN_DEFAULT_COUNT 10          // Keys returned per SCAN call unless asked otherwise
+#define SCAN_MAX_COUNT 1000            // Most keys one SCAN call may return
 
 #endif // CONFIG_H
@@ -0,0 +1,54 @@
+#ifndef CUCKOO_FILTER_H
+#define CUCKOO_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fingerprints per bucket. A bucket of 16-bit fingerprints is 8 bytes, so a
+// lookup touches at most two cache lines.
+#define CUCKOO_BUCKET_SIZE 4
+
+// Relocations tried before an insert gives up and the filter must be rebuilt
+#define CUCKOO_MAX_KICKS 500
+
+// Approximate set membership with deletion support. contains() never reports
+// a false negative for an inserted key, but may report a key that was never
+// inserted with probability of roughly 2 * CUCKOO_BUCKET_SIZE / 65536.
+typedef struct
+{
+    uint16_t (*buckets)[CUCKOO_BUCKET_SIZE]; // 0 marks an empty slot
+    size_t num_buckets;                      // Always a power of two
+    size_t count;                            // Fingerprints stored
+    uint64_t rng;                            // Picks the slot to evict
+} CuckooFilter;
+
+// Allocate a filter with room for at least `capacity` keys
+// Returns: 0 on success, -1 on allocation failure
+int cuckoo_init(CuckooFilter *filter, size_t capacity);
+
+// Release the filter's memory
+void cuckoo_free(CuckooFilter *filter);
+
+// Forget every key, keeping the allocated buckets
+void cuckoo_clear(CuckooFilter *filter);
+
+// Add a key. On failure one stored fingerprint has been displaced, so the
+// filter no longer covers every key and must be rebuilt.
+// Returns: 0 on success, -1 if the filter is too full
+int cuckoo_insert(CuckooFilter *filter, const char *key, size_t len);
+
+// Check whether a key may have been inserted
+// Returns: 1 if the key may be present, 0 if it is definitely absent
+int cuckoo_contains(const CuckooFilter *filter, const char *key, size_t len);
+
+// Remove a key. Only call this for keys that were inserted.
+// Returns: 0 on success, -1 if no matching fingerprint was found
+int cuckoo_delete(CuckooFilter *filter, const char *key, size_t len);
+
+// Number of fingerprint slots
+size_t cuckoo_capacity(const CuckooFilter *filter);
+
+// Bytes used by the bucket array
+size_t cuckoo_memory(const CuckooFilter *filter);
+
+#endif // CUCKOO_FILTER_H
@@ -7,6 +7,13 @@
 // Version 1.0
 // Last modified: 2023-05-15
 
+// Value flags stored next to each value
+#define VALUE_FLAG_PLAIN 0x1 // String value that serializes to JSON without escaping
+
+// How a node's value object holds the value
+#define VALUE_ENCODING_RAW 0 // The value as it was set
+#define VALUE_ENCODING_LZ4 1 // A string holding an LZ4 block of the value's raw_len bytes
+
 // KeyValue structure representing a node in the AVL tree
 typedef struct KeyValue
 {
@@ -15,21 +22,82 @@ typedef struct KeyValue
     struct KeyValue *left;
     struct KeyValue *right;
     int height;
+    int flags;      // VALUE_FLAG_* bits of the value as it was set
+    int encoding;   // VALUE_ENCODING_*
+    size_t raw_len; // Length of an encoded value once decoded
 } KeyValue;
 
+// Database statistics reported by STATS
+typedef struct
+{
+    size_t keys;
+    int filter_enabled;
+    size_t filter_capacity;                      // Fingerprint slots in the key filter
+    size_t filter_items;                         // Fingerprints stored
+    size_t filter_bytes;                         // Memory used by the filter
+    unsigned long long filter_lookups;           // Lookups that consulted the filter
+    unsigned long long filter_negatives;         // Misses answered without walking the tree
+    unsigned long long filter_false_positives;   // Misses the filter passed on to the tree
+    size_t compress_threshold;                   // Smallest value compressed, 0 when disabled
+    size_t compressed_values;                    // Values stored compressed
+    size_t compressed_bytes;                     // Their size as stored
+    size_t compressed_raw_bytes;                 // Their size once decoded
+} DbStats;
+
 // Database operation function prototypes
 
 // Initialize the database
 // Returns: void
 void db_init(void);
 
+// Keep a cuckoo filter of stored keys so lookups of missing keys can skip
+// the tree walk. The filter grows as keys are added.
+// Parameters:
+//   capacity: Number of keys to size the filter for initially
+// Returns: 0 on success, -1 on allocation failure
+int db_enable_filter(size_t capacity);
+
+// Drop the key filter, if any
+// Returns: void
+void db_disable_filter(void);
+
+// Compress string values of at least `threshold` bytes with LZ4 when that
+// saves memory. Values are decompressed when read.
+// Parameters:
+//   threshold: Smallest value to compress, 0 to stop compressing new values
+// Returns: 0 on success, -1 if the server was built without LZ4
+int db_enable_compression(size_t threshold);
+
 // Retrieve a value from the database
 // Parameters:
 //   key: The key to look up
-// Returns: json_object* if found, NULL if not found
+// Returns: json_object* as stored if found, NULL if not found. An encoded
+//          value holds compressed bytes; see db_decode_value.
 json_object *db_get(const char *key);
 
-// Insert or update a key-value pair in the database
+// Retrieve the node holding a key, including its value flags
+// Parameters:
+//   key: The key to look up
+// Returns: const KeyValue* if found, NULL if not found
+const KeyValue *db_lookup(const char *key);
+
+// Decompress a node's encoded value
+// Parameters:
+//   node: A node whose encoding is not VALUE_ENCODING_RAW
+//   out: Receives the node->raw_len decoded bytes
+// Returns: 0 on success, -1 if the value cannot be decoded
+int db_decode(const KeyValue *node, char *out);
+
+// Get a node's value as it was set
+// Parameters:
+//   node: The node, from db_lookup or a walk of the keys
+// Returns: a new reference the caller must put, NULL on failure
+json_object *db_decode_value(const KeyValue *node);
+
+// Insert or update a key-value pair in the database. The database takes
+// over the caller's reference, and may drop it at once when it stores a
+// compressed copy instead, so a caller that still needs the value must hold
+// a reference of its own.
 // Parameters:
 //   key: The key to set
 //   value: The value to associate with the key
@@ -39,9 +107,38 @@ int db_set(const char *key, json_object *value);
 // Delete a key-value pair from the database
 // Parameters:
 //   key: The key to delete
-// Returns: 0 on success, -1 if key not found
+// Returns: 0 on success, -1 if key is NULL or not found
 int db_delete(const char *key);
 
+// Delete a key like db_delete, but free a large value on the lazyfree
+// thread instead of the caller's
+// Parameters:
+//   key: The key to delete
+// Returns: 0 on success, -1 if key is NULL or not found
+int db_unlink(const char *key);
+
+// Visit up to count keys, in key order, that sort after a cursor. Keys
+// added or removed between calls do not disturb the walk.
+// Parameters:
+//   after: The last key of the previous call, or NULL to start
+//   count: Most keys to visit
+//   fn: Called once per pair; must not modify the database
+//   ctx: Passed through to fn
+// Returns: 1 if keys remain after the last one visited, 0 otherwise
+int db_scan(const char *after, size_t count, void (*fn)(const KeyValue *node, void *ctx), void *ctx);
+
+// Report database statistics
+// Parameters:
+//   stats: Filled in with the current statistics
+// Returns: void
+void db_stats(DbStats *stats);
+
+// Remove every key
+// Parameters:
+//   async: Free the old keys on the lazyfree thread instead of the caller's
+// Returns: void
+void db_flush(int async);
+
 // Clean up the entire database
 // Returns: void
 void db_cleanup(void);
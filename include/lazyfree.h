@@ -0,0 +1,27 @@
+#ifndef LAZYFREE_H
+#define LAZYFREE_H
+
+#include <stddef.h>
+
+// Queue work that frees memory on a background thread, started on first use.
+// If the thread cannot be started the work runs immediately instead.
+// Parameters:
+//   fn: Frees whatever arg holds; runs on the background thread
+//   arg: Passed through to fn
+//   objects: Number of objects the work frees, reported until it is done
+void lazyfree_submit(void (*fn)(void *arg), void *arg, size_t objects);
+
+// Serialize json-c reference counting with the background thread. The
+// counts are not atomic, so the server holds this lock while dropping its
+// reference to a value that may also be queued for freeing, and the
+// background thread holds it while freeing values.
+void lazyfree_lock(void);
+void lazyfree_unlock(void);
+
+// Number of objects waiting to be freed
+size_t lazyfree_pending(void);
+
+// Finish queued work and stop the background thread
+void lazyfree_shutdown(void);
+
+#endif // LAZYFREE_H
@@ -0,0 +1,135 @@
+#ifndef MINIREDIS_H
+#define MINIREDIS_H
+
+// libminiredis - C client library for the Mini-Redis server
+//
+// A MiniRedis is one persistent connection. Commands are queued with the
+// miniredis_submit* functions, go out together on the next write, and their
+// replies are handed to callbacks in the order the commands were submitted.
+// The blocking helpers (miniredis_get, miniredis_set, ...) are built on the
+// same queue and wait for their own reply.
+//
+// A connection is used by one thread at a time. MiniRedisPool hands idle
+// connections out to any number of threads.
+
+#include <stddef.h>
+
+#define MINIREDIS_READ_SIZE (16 * 1024) // Bytes read from the socket at a time
+
+typedef struct MiniRedis MiniRedis;
+typedef struct MiniRedisPool MiniRedisPool;
+
+// The reply to one command: a line per command of a batch, one line
+// otherwise, without newlines. Lines point into the connection's read buffer
+// and are only valid during the callback.
+typedef struct
+{
+    size_t count;
+    const char **lines;
+    const size_t *lengths;
+} MiniRedisReply;
+
+// Called with the reply to a submitted command, or with NULL when the
+// connection failed before the reply arrived. Callbacks may submit further
+// commands but must not close the connection.
+typedef void (*MiniRedisCallback)(MiniRedis *conn, const MiniRedisReply *reply, void *ctx);
+
+// Connect to a server. The socket is non-blocking; blocking helpers wait
+// with poll().
+// Parameters:
+//   host: Host name or address
+//   port: TCP port
+// Returns: MiniRedis* on success, NULL on failure with errno set
+MiniRedis *miniredis_connect(const char *host, int port);
+
+// Close a connection. Callbacks still pending are called with NULL.
+void miniredis_close(MiniRedis *conn);
+
+// Limit how long blocking calls wait for replies
+// Parameters:
+//   timeout_ms: Milliseconds, or -1 (the default) to wait forever
+void miniredis_set_timeout(MiniRedis *conn, int timeout_ms);
+
+// Whether the connection has failed; a failed connection rejects commands
+int miniredis_failed(const MiniRedis *conn);
+
+// Queue a command given as JSON. The reply is taken to be one line, so the
+// command must be one the server answers with a single line: not EXEC,
+// BATCH, SUBSCRIBE or PSUBSCRIBE, whose extra lines would be read as the
+// replies of later commands and fail the connection. Use
+// miniredis_submit_mget and miniredis_submit_mset for several keys at once.
+// Parameters:
+//   json: One JSON command object answered with a single line
+//   len: Length of json
+//   cb: Called with the reply, may be NULL
+//   ctx: Passed through to cb
+// Returns: 0 on success, -1 if the connection has failed
+int miniredis_submit(MiniRedis *conn, const char *json, size_t len, MiniRedisCallback cb, void *ctx);
+
+// Queue a GET, SET or DEL. Keys and values are escaped as needed.
+int miniredis_submit_get(MiniRedis *conn, const char *key, MiniRedisCallback cb, void *ctx);
+int miniredis_submit_set(MiniRedis *conn, const char *key, const char *value, size_t value_len, MiniRedisCallback cb, void *ctx);
+int miniredis_submit_del(MiniRedis *conn, const char *key, MiniRedisCallback cb, void *ctx);
+
+// Queue a GET or SET of several keys as one atomic BATCH. The reply has a
+// line per key, or a single "ERROR: " line if the server refused the batch.
+int miniredis_submit_mget(MiniRedis *conn, const char *const *keys, size_t count, MiniRedisCallback cb, void *ctx);
+int miniredis_submit_mset(MiniRedis *conn, const char *const *keys, const char *const *values, size_t count,
+                          MiniRedisCallback cb, void *ctx);
+
+// Send queued commands and collect replies until none are outstanding
+// Returns: 0 on success, -1 if the connection failed or timed out
+int miniredis_wait(MiniRedis *conn);
+
+// Decode the reply line of a GET
+// Parameters:
+//   line, len: The reply line
+//   value: Receives a malloc'd, NUL-terminated copy of the value
+//   value_len: Receives the value's length, may be NULL
+// Returns: 1 if found, 0 if the key does not exist, -1 on an error reply
+int miniredis_parse_value(const char *line, size_t len, char **value, size_t *value_len);
+
+// Blocking helpers. Values returned through `value` are malloc'd.
+// Returns: 1 if the key was found (GET) or deleted (DEL), 0 if it does not
+// exist, 0 for a successful SET, -1 on error
+int miniredis_get(MiniRedis *conn, const char *key, char **value, size_t *value_len);
+int miniredis_set(MiniRedis *conn, const char *key, const char *value);
+int miniredis_del(MiniRedis *conn, const char *key);
+
+// Blocking MGET: values[i] receives a malloc'd value, or NULL if keys[i] does
+// not exist. MSET sets every key or, on error, none.
+// Returns: 0 on success, -1 on error
+int miniredis_mget(MiniRedis *conn, const char *const *keys, size_t count, char **values);
+int miniredis_mset(MiniRedis *conn, const char *const *keys, const char *const *values, size_t count);
+
+// Event loop integration. Watch miniredis_fd() for reading, and for writing
+// while miniredis_wants_write() is true, then call the matching handler.
+// Handlers return 0, or -1 once the connection has failed.
+int miniredis_fd(const MiniRedis *conn);
+int miniredis_wants_write(const MiniRedis *conn);
+int miniredis_on_readable(MiniRedis *conn);
+int miniredis_on_writable(MiniRedis *conn);
+
+// Be told whenever miniredis_wants_write() changes, to update the loop's
+// interest in writability
+void miniredis_set_write_hook(MiniRedis *conn, void (*hook)(MiniRedis *conn, int want_write, void *data), void *data);
+
+// Create a pool of up to max_connections connections to one server.
+// Connections are opened on demand and kept open between uses.
+// Returns: MiniRedisPool* on success, NULL on allocation failure
+MiniRedisPool *miniredis_pool_create(const char *host, int port, size_t max_connections);
+
+// Take an idle connection, opening one if the pool is not full, or waiting
+// for one to be released
+// Returns: MiniRedis* on success, NULL if a new connection failed
+MiniRedis *miniredis_pool_acquire(MiniRedisPool *pool);
+
+// Return a connection to the pool. Failed connections, and ones with
+// replies still outstanding, are closed instead.
+void miniredis_pool_release(MiniRedisPool *pool, MiniRedis *conn);
+
+// Close every idle connection and free the pool. Connections that are still
+// acquired must be released first.
+void miniredis_pool_destroy(MiniRedisPool *pool);
+
+#endif // MINIREDIS_H
@@ -0,0 +1,42 @@
+#ifndef MULTI_H
+#define MULTI_H
+
+#include <json-c/json.h>
+#include "client.h"
+
+#define MULTI_TABLE_SIZE 1024 // Buckets in the watched-key hash table
+
+// Start queueing a client's commands for EXEC
+void multi_begin(Client *client);
+
+// Queue a command inside MULTI, or record why it cannot be queued so EXEC
+// refuses the whole transaction
+void multi_queue(Client *client, json_object *command);
+
+// Run every queued command back to back, unless a watched key changed or a
+// command could not be queued. Ends the transaction and clears the watches.
+void multi_exec(Client *client);
+
+// Drop the queued commands and watches
+void multi_discard(Client *client);
+
+// Run a BATCH command: every entry of its "commands" array is checked
+// first, then all of them run back to back, or none do
+void multi_batch(Client *client, json_object *command);
+
+// Watch a key so EXEC aborts if it changes before then
+void multi_watch(Client *client, const char *key);
+
+// Forget every key a client watches
+void multi_unwatch(Client *client);
+
+// Mark clients watching a key as unable to EXEC. Called on every write.
+void multi_touch_key(const char *key);
+
+// Mark every watching client, used when the whole keyspace is replaced
+void multi_touch_all(void);
+
+// Release transaction state of a client that is going away
+void multi_client_free(Client *client);
+
+#endif // MULTI_H
@@ -0,0 +1,42 @@
+#ifndef NET_H
+#define NET_H
+
+#include "client.h"
+
+// A networking backend drives accept/recv/send for every client. Commands
+// run on the backend's thread; backends only move bytes.
+typedef struct
+{
+    const char *name;
+
+    // Prepare to serve connections on the listening socket
+    // Returns: 0 on success, -1 if the backend is unavailable
+    int (*init)(int server_socket);
+
+    // Serve connections until the process exits, calling server_cron()
+    // about once a second
+    void (*run)(void);
+
+    // Output was queued for a client outside its own read path
+    void (*wake)(Client *client);
+
+    // Close a client outside its own read path, dropping unsent output.
+    // The client may be freed before this returns.
+    void (*close)(Client *client);
+
+    // Serve a connected (or connecting) socket the server opened itself.
+    // Queued output is written once the socket becomes writable.
+    // Returns: 0 on success, -1 on failure; the caller frees the client
+    int (*attach)(Client *client);
+} NetBackend;
+
+// Readiness-based backend using epoll, always available
+extern const NetBackend net_epoll;
+
+// Completion-based backend using io_uring, Linux 5.19 or newer
+extern const NetBackend net_uring;
+
+// Backend chosen at startup
+extern const NetBackend *net_backend;
+
+#endif // NET_H
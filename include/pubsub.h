@@ -0,0 +1,40 @@
+#ifndef PUBSUB_H
+#define PUBSUB_H
+
+#include <stddef.h>
+#include "client.h"
+
+#define PUBSUB_TABLE_SIZE 1024 // Buckets in the channel hash table
+
+// Subscribers with more unsent output than this are disconnected rather
+// than left to grow without bound (0 disables the limit)
+extern size_t pubsub_output_limit;
+
+// Subscribe a client to a channel, or to every channel matching a glob
+// pattern, and queue the confirmation
+// Parameters:
+//   name: Channel name or fnmatch(3) pattern
+//   pattern: Non-zero if `name` is a pattern
+void pubsub_subscribe(Client *client, const char *name, int pattern);
+
+// Unsubscribe a client and queue one confirmation per subscription removed
+// Parameters:
+//   name: Channel name or pattern, NULL for all of the client's channels or patterns
+//   pattern: Non-zero to remove pattern subscriptions
+void pubsub_unsubscribe(Client *client, const char *name, int pattern);
+
+// Deliver a message to every subscriber of a channel. The message is encoded
+// once per channel or matching pattern and shared by every subscriber's
+// output queue.
+// Parameters:
+//   publisher: The client issuing PUBLISH; its own output is flushed by its read path
+// Returns: number of deliveries
+size_t pubsub_publish(Client *publisher, const char *channel, const char *message);
+
+// Drop every subscription of a client that is going away, without replies
+void pubsub_client_free(Client *client);
+
+// Number of channels and patterns with at least one subscriber
+void pubsub_counts(size_t *channels, size_t *patterns);
+
+#endif // PUBSUB_H
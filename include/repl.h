@@ -0,0 +1,67 @@
+#ifndef REPL_H
+#define REPL_H
+
+#include <stddef.h>
+#include <json-c/json.h>
+#include "client.h"
+
+#define REPL_ID_SIZE 40 // Hex characters in a replication ID
+
+// Replication state reported by STATS
+typedef struct
+{
+    int replica;                      // Following a primary
+    const char *replid;               // History this node's offset belongs to
+    unsigned long long offset;        // Bytes of the replication stream applied or produced
+    size_t replicas;                  // Connected replicas
+    size_t backlog_bytes;             // Stream bytes kept for partial resyncs
+    unsigned long long full_syncs;    // Replicas served a full snapshot
+    unsigned long long partial_syncs; // Replicas resumed from the backlog
+    const char *master_host;
+    int master_port;
+    int master_link_up;               // Connected to the primary and caught up with its snapshot
+} ReplStats;
+
+// Pick a fresh replication ID
+void repl_init(void);
+
+// Handle PSYNC from a replica: resume from the backlog when it holds the
+// requested offset of this node's history, otherwise send a full snapshot.
+// The connection then receives every write as it happens.
+// Parameters:
+//   replid: Replication ID the replica last followed
+//   offset: Stream offset the replica has applied, as a decimal string
+void repl_psync(Client *client, const char *replid, const char *offset);
+
+// Queue the next part of a snapshot being sent to a replica, and once every
+// key has gone out, the writes made meanwhile
+// Returns: 1 if output was queued, 0 if no snapshot is in progress
+int repl_refill(Client *client);
+
+// Send a write to the backlog and every replica. Called after the write has
+// been applied to the database.
+void repl_propagate_set(const char *key, json_object *value);
+void repl_propagate_del(const char *key, int lazy); // lazy: sent as UNLINK
+void repl_propagate_flushall(void);
+
+// Follow a primary, or stop following one when host is NULL. The connection
+// is made, and remade after failures, from repl_cron().
+// Returns: 0 on success, -1 if the host name is too long
+int repl_replicaof(const char *host, int port);
+
+// Whether this node follows a primary and rejects client writes
+int repl_is_replica(void);
+
+// Apply one message from the primary's replication stream
+void repl_apply(Client *client, json_object *command);
+
+// Periodic work: connect to the primary when the link is down
+void repl_cron(void);
+
+// Forget a replica or primary connection that is being freed
+void repl_client_free(Client *client);
+
+// Report replication state
+void repl_stats(ReplStats *stats);
+
+#endif // REPL_H
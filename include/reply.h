@@ -0,0 +1,120 @@
+#ifndef REPLY_H
+#define REPLY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <json-c/json.h>
+#include "database.h"
+
+#define REPLY_CHUNK_SIZE 4096 // Small replies are coalesced into buffers of this size
+#define REPLY_REF_MIN 512     // Plain values at least this large are referenced, not copied
+
+// One piece of queued output. Segments either own a coalescing buffer or
+// reference memory held alive by `owner` (a pinned value, a shared buffer)
+// until `release` runs.
+typedef struct ReplySegment
+{
+    char *data;
+    size_t len;
+    size_t capacity; // Non-zero for owned coalescing buffers
+    void (*release)(void *owner);
+    void *owner;
+    int zerocopy;    // Some of the bytes went out with MSG_ZEROCOPY
+    uint32_t zc_seq; // Zerocopy send that last touched this segment
+    struct ReplySegment *next;
+} ReplySegment;
+
+// Per-client output queue. Fully written segments that went out with
+// MSG_ZEROCOPY wait on `zc_head` until the kernel reports them complete.
+typedef struct
+{
+    ReplySegment *head;
+    ReplySegment *tail;
+    size_t bytes; // Bytes queued and not yet written
+    size_t sent;  // Bytes of `head` already written
+    ReplySegment *zc_head;
+    ReplySegment *zc_tail;
+    uint32_t zc_issued;
+    uint32_t zc_completed;
+    int zc_enabled; // -1 unsupported, 0 not yet tried, 1 enabled
+} ReplyQueue;
+
+// Bytes encoded once and referenced by several output queues, such as a
+// published message or a replicated command
+typedef struct
+{
+    int refcount;
+    size_t len;
+    char data[];
+} ReplyShared;
+
+extern size_t zerocopy_threshold;
+
+// Initialize an empty queue
+void reply_queue_init(ReplyQueue *queue);
+
+// Release every segment, including ones waiting on zerocopy completion
+void reply_queue_free(ReplyQueue *queue);
+
+// Move every segment of `from` to the end of `queue`, leaving `from` empty.
+// Nothing may have been written from `from`.
+void reply_queue_append(ReplyQueue *queue, ReplyQueue *from);
+
+// Append a copy of bytes, coalescing with the previous small reply
+void reply_add(ReplyQueue *queue, const char *data, size_t len);
+
+// Append a reference to bytes that stay valid until release(owner) runs
+void reply_add_ref(ReplyQueue *queue, const char *data, size_t len, void (*release)(void *owner), void *owner);
+
+// Allocate a shared buffer of `len` bytes for the caller to fill. The caller
+// holds one reference.
+// Returns: ReplyShared* on success, NULL on allocation failure
+ReplyShared *reply_shared_new(size_t len);
+
+// Drop one reference to a shared buffer, freeing it with the last
+void reply_shared_release(ReplyShared *shared);
+
+// Append a reference to a shared buffer, taking a new reference for the queue
+void reply_add_shared(ReplyQueue *queue, ReplyShared *shared);
+
+// Append a stored value as JSON followed by a newline. Large plain strings
+// are referenced in place with the value pinned, compressed values are
+// decoded into a buffer the queue references, and others are copied.
+// Parameters:
+//   node: The node holding the value
+void reply_add_value(ReplyQueue *queue, const KeyValue *node);
+
+// Append a stored value as stored, for clients that decode it themselves:
+// {"encoding":"lz4","length":<decoded bytes>,"data":"<base64 LZ4 block>"}
+// or {"encoding":"raw","data":<value>}, followed by a newline
+// Parameters:
+//   node: The node holding the value
+void reply_add_encoded(ReplyQueue *queue, const KeyValue *node);
+
+// Fill iovecs with queued output, starting at the first unsent byte
+// Returns: number of iovecs filled
+int reply_fill_iov(const ReplyQueue *queue, struct iovec *iov, int max);
+
+// Whether the next write should use zerocopy: a large referenced segment is
+// at the front of the queue
+int reply_wants_zerocopy(const ReplyQueue *queue);
+
+// Account for `len` written bytes. With `zerocopy` set, segments that are
+// finished move to the completion list under sequence number zc_issued - 1.
+void reply_consume(ReplyQueue *queue, size_t len, int zerocopy);
+
+// Release zerocopy segments whose sends are below `completed`
+void reply_zerocopy_complete(ReplyQueue *queue, uint32_t completed);
+
+// Whether zerocopy sends are still waiting on completion
+int reply_zerocopy_pending(const ReplyQueue *queue);
+
+// Write as much queued output to a non-blocking socket as it accepts
+// Returns: 0 when the queue is empty, 1 if output remains, -1 on error
+int reply_flush(int fd, ReplyQueue *queue);
+
+// Read zerocopy completions from a socket's error queue
+void reply_zerocopy_reap(int fd, ReplyQueue *queue);
+
+#endif // REPLY_H
@@ -1,8 +1,12 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <json-c/json.h>
+#include "client.h"
+
 int start_server(int port);
 void signal_handler(int signum);
-void handle_client(int client_socket);
+void execute_command(Client *client, struct json_object *parsed_json);
 void accept_connections();
-#endif
\ No newline at end of file
+void server_cron(void);
+#endif
@@ -0,0 +1,945 @@
+// miniredis.c - Client library for the Mini-Redis project
+// This file implements libminiredis: pipelined connections that queue JSON
+// commands and match reply lines to them in order, blocking helpers built on
+// top, hooks for external event loops and a thread-safe connection pool.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "miniredis.h"
+
+// A submitted command waiting for its reply
+typedef struct
+{
+    MiniRedisCallback cb;
+    void *ctx;
+    size_t lines; // Reply lines expected: one, or one per command of a batch
+} Pending;
+
+struct MiniRedis
+{
+    int fd;
+    int failed;
+    int error; // errno that failed the connection
+    int timeout_ms;
+
+    // Commands not yet written
+    char *out;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+
+    // Bytes read and not yet handed to a callback. `scan` is where the search
+    // for the next newline resumes; the lines found so far for the reply at
+    // the head of `pending` are recorded as offsets into `in`.
+    char *in;
+    size_t in_len;
+    size_t in_cap;
+    size_t scan;
+    size_t *line_starts;
+    size_t *line_lens;
+    const char **line_ptrs;
+    size_t line_count;
+    size_t line_cap;
+
+    // Ring of commands waiting for replies, oldest at `pending_head`
+    Pending *pending;
+    size_t pending_head;
+    size_t pending_count;
+    size_t pending_cap;
+
+    void (*write_hook)(MiniRedis *conn, int want_write, void *data);
+    void *write_hook_data;
+    int write_wanted; // Last state reported to the write hook
+};
+
+struct MiniRedisPool
+{
+    char *host;
+    int port;
+    size_t max_connections;
+    size_t open; // Connections idle or acquired
+    MiniRedis **idle;
+    size_t idle_count;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+};
+
+// Grow a buffer to hold at least `need` bytes
+// Returns: 0 on success, -1 on allocation failure
+static int reserve(char **buf, size_t *cap, size_t need)
+{
+    if (need <= *cap)
+        return 0;
+
+    size_t new_cap = *cap ? *cap : MINIREDIS_READ_SIZE;
+    while (new_cap < need)
+        new_cap *= 2;
+    char *grown = (char *)realloc(*buf, new_cap);
+    if (grown == NULL)
+        return -1;
+    *buf = grown;
+    *cap = new_cap;
+    return 0;
+}
+
+// Tell the write hook when the connection starts or stops having output
+static void update_write_interest(MiniRedis *conn)
+{
+    int want = miniredis_wants_write(conn);
+    if (want == conn->write_wanted)
+        return;
+    conn->write_wanted = want;
+    if (conn->write_hook)
+        conn->write_hook(conn, want, conn->write_hook_data);
+}
+
+// Mark the connection failed and fail every command waiting on it
+static void fail_connection(MiniRedis *conn, int error)
+{
+    if (conn->failed)
+        return;
+    conn->failed = 1;
+    conn->error = error;
+    conn->out_len = conn->out_sent = 0;
+
+    while (conn->pending_count > 0)
+    {
+        Pending entry = conn->pending[conn->pending_head];
+        conn->pending_head = (conn->pending_head + 1) % conn->pending_cap;
+        conn->pending_count--;
+        if (entry.cb)
+            entry.cb(conn, NULL, entry.ctx);
+    }
+    update_write_interest(conn);
+    errno = error;
+}
+
+MiniRedis *miniredis_connect(const char *host, int port)
+{
+    struct addrinfo hints, *addrs = NULL;
+    char service[16];
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+
+    int rc = getaddrinfo(host, service, &hints, &addrs);
+    if (rc != 0)
+    {
+        errno = (rc == EAI_SYSTEM) ? errno : EHOSTUNREACH;
+        return NULL;
+    }
+
+    int fd = -1;
+    int error = ECONNREFUSED;
+    for (struct addrinfo *ai = addrs; ai != NULL; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+        {
+            error = errno;
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        error = errno;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    if (fd < 0)
+    {
+        errno = error;
+        return NULL;
+    }
+
+    // Pipelined commands are written in batches, so never hold them back
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        error = errno;
+        close(fd);
+        errno = error;
+        return NULL;
+    }
+
+    MiniRedis *conn = (MiniRedis *)calloc(1, sizeof(MiniRedis));
+    if (conn == NULL)
+    {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    conn->fd = fd;
+    conn->timeout_ms = -1;
+    return conn;
+}
+
+void miniredis_close(MiniRedis *conn)
+{
+    if (conn == NULL)
+        return;
+
+    fail_connection(conn, ECONNABORTED);
+    close(conn->fd);
+    free(conn->out);
+    free(conn->in);
+    free(conn->line_starts);
+    free(conn->line_lens);
+    free(conn->line_ptrs);
+    free(conn->pending);
+    free(conn);
+}
+
+void miniredis_set_timeout(MiniRedis *conn, int timeout_ms)
+{
+    conn->timeout_ms = timeout_ms;
+}
+
+int miniredis_failed(const MiniRedis *conn)
+{
+    return conn->failed;
+}
+
+// Record a command waiting for `lines` reply lines
+// Returns: 0 on success, -1 on allocation failure
+static int push_pending(MiniRedis *conn, MiniRedisCallback cb, void *ctx, size_t lines)
+{
+    if (conn->pending_count == conn->pending_cap)
+    {
+        size_t new_cap = conn->pending_cap ? conn->pending_cap * 2 : 64;
+        Pending *grown = (Pending *)malloc(new_cap * sizeof(Pending));
+        if (grown == NULL)
+            return -1;
+        // Unwrap the ring into the new array
+        for (size_t i = 0; i < conn->pending_count; i++)
+            grown[i] = conn->pending[(conn->pending_head + i) % conn->pending_cap];
+        free(conn->pending);
+        conn->pending = grown;
+        conn->pending_head = 0;
+        conn->pending_cap = new_cap;
+    }
+
+    Pending *entry = &conn->pending[(conn->pending_head + conn->pending_count) % conn->pending_cap];
+    entry->cb = cb;
+    entry->ctx = ctx;
+    entry->lines = lines;
+    conn->pending_count++;
+    return 0;
+}
+
+// Append raw bytes to the output buffer
+static int append(MiniRedis *conn, const char *data, size_t len)
+{
+    if (reserve(&conn->out, &conn->out_cap, conn->out_len + len) < 0)
+        return -1;
+    memcpy(conn->out + conn->out_len, data, len);
+    conn->out_len += len;
+    return 0;
+}
+
+// Append a JSON string literal, escaping quotes, backslashes and control
+// characters
+static int append_string(MiniRedis *conn, const char *s, size_t len)
+{
+    // Worst case every byte becomes a six-byte \u00XX escape
+    if (reserve(&conn->out, &conn->out_cap, conn->out_len + len * 6 + 2) < 0)
+        return -1;
+
+    static const char hex[] = "0123456789abcdef";
+    char *p = conn->out + conn->out_len;
+    *p++ = '"';
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\')
+        {
+            *p++ = '\\';
+            *p++ = (char)c;
+        }
+        else if (c < 0x20)
+        {
+            *p++ = '\\';
+            *p++ = 'u';
+            *p++ = '0';
+            *p++ = '0';
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 0xf];
+        }
+        else
+            *p++ = (char)c;
+    }
+    *p++ = '"';
+    conn->out_len = p - conn->out;
+    return 0;
+}
+
+// Append {"key":<key>,"operation":"<op>"[,"value":<value>]}
+static int append_command(MiniRedis *conn, const char *key, const char *op, const char *value, size_t value_len)
+{
+    if (append(conn, "{\"key\":", 7) < 0 || append_string(conn, key, strlen(key)) < 0 ||
+        append(conn, ",\"operation\":\"", 14) < 0 || append(conn, op, strlen(op)) < 0 || append(conn, "\"", 1) < 0)
+        return -1;
+    if (value && (append(conn, ",\"value\":", 9) < 0 || append_string(conn, value, value_len) < 0))
+        return -1;
+    return append(conn, "}", 1);
+}
+
+// Finish queuing a command whose bytes were appended from `start`, or undo
+// the append if it failed part way
+static int finish_submit(MiniRedis *conn, size_t start, int rc, MiniRedisCallback cb, void *ctx, size_t lines)
+{
+    if (rc < 0 || push_pending(conn, cb, ctx, lines) < 0)
+    {
+        conn->out_len = start;
+        errno = ENOMEM;
+        return -1;
+    }
+    update_write_interest(conn);
+    return 0;
+}
+
+// Check the connection can take another command
+static int check_usable(MiniRedis *conn)
+{
+    if (conn->failed)
+    {
+        errno = conn->error;
+        return -1;
+    }
+    return 0;
+}
+
+int miniredis_submit(MiniRedis *conn, const char *json, size_t len, MiniRedisCallback cb, void *ctx)
+{
+    if (check_usable(conn) < 0)
+        return -1;
+    size_t start = conn->out_len;
+    return finish_submit(conn, start, append(conn, json, len), cb, ctx, 1);
+}
+
+int miniredis_submit_get(MiniRedis *conn, const char *key, MiniRedisCallback cb, void *ctx)
+{
+    if (check_usable(conn) < 0)
+        return -1;
+    size_t start = conn->out_len;
+    return finish_submit(conn, start, append_command(conn, key, "GET", NULL, 0), cb, ctx, 1);
+}
+
+int miniredis_submit_set(MiniRedis *conn, const char *key, const char *value, size_t value_len,
+                         MiniRedisCallback cb, void *ctx)
+{
+    if (check_usable(conn) < 0)
+        return -1;
+    size_t start = conn->out_len;
+    return finish_submit(conn, start, append_command(conn, key, "SET", value, value_len), cb, ctx, 1);
+}
+
+int miniredis_submit_del(MiniRedis *conn, const char *key, MiniRedisCallback cb, void *ctx)
+{
+    if (check_usable(conn) < 0)
+        return -1;
+    size_t start = conn->out_len;
+    return finish_submit(conn, start, append_command(conn, key, "DEL", NULL, 0), cb, ctx, 1);
+}
+
+// Queue a BATCH running `op` on every key, with values for SET
+static int submit_batch(MiniRedis *conn, const char *op, const char *const *keys, const char *const *values,
+                        size_t count, MiniRedisCallback cb, void *ctx)
+{
+    if (check_usable(conn) < 0)
+        return -1;
+    if (count == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t start = conn->out_len;
+    int rc = append(conn, "{\"operation\":\"BATCH\",\"commands\":[", 33);
+    for (size_t i = 0; i < count && rc == 0; i++)
+    {
+        if (i > 0)
+            rc = append(conn, ",", 1);
+        if (rc == 0)
+            rc = append_command(conn, keys[i], op, values ? values[i] : NULL, values ? strlen(values[i]) : 0);
+    }
+    if (rc == 0)
+        rc = append(conn, "]}", 2);
+    return finish_submit(conn, start, rc, cb, ctx, count);
+}
+
+int miniredis_submit_mget(MiniRedis *conn, const char *const *keys, size_t count, MiniRedisCallback cb, void *ctx)
+{
+    return submit_batch(conn, "GET", keys, NULL, count, cb, ctx);
+}
+
+int miniredis_submit_mset(MiniRedis *conn, const char *const *keys, const char *const *values, size_t count,
+                          MiniRedisCallback cb, void *ctx)
+{
+    return submit_batch(conn, "SET", keys, values, count, cb, ctx);
+}
+
+int miniredis_fd(const MiniRedis *conn)
+{
+    return conn->fd;
+}
+
+int miniredis_wants_write(const MiniRedis *conn)
+{
+    return !conn->failed && conn->out_sent < conn->out_len;
+}
+
+void miniredis_set_write_hook(MiniRedis *conn, void (*hook)(MiniRedis *conn, int want_write, void *data), void *data)
+{
+    conn->write_hook = hook;
+    conn->write_hook_data = data;
+    conn->write_wanted = -1; // Report the current state on the next change
+    update_write_interest(conn);
+}
+
+int miniredis_on_writable(MiniRedis *conn)
+{
+    if (conn->failed)
+        return -1;
+
+    while (conn->out_sent < conn->out_len)
+    {
+        ssize_t n = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            fail_connection(conn, errno);
+            return -1;
+        }
+        conn->out_sent += n;
+    }
+    // Drop what was written once it is most of the buffer, so the buffer does
+    // not grow while commands keep being queued behind a slow socket
+    if (conn->out_sent == conn->out_len)
+        conn->out_len = conn->out_sent = 0;
+    else if (conn->out_sent > conn->out_len / 2)
+    {
+        memmove(conn->out, conn->out + conn->out_sent, conn->out_len - conn->out_sent);
+        conn->out_len -= conn->out_sent;
+        conn->out_sent = 0;
+    }
+    update_write_interest(conn);
+    return 0;
+}
+
+// Record a reply line found at `start` in the read buffer
+static int push_line(MiniRedis *conn, size_t start, size_t len)
+{
+    if (conn->line_count == conn->line_cap)
+    {
+        size_t new_cap = conn->line_cap ? conn->line_cap * 2 : 16;
+        size_t *starts = (size_t *)realloc(conn->line_starts, new_cap * sizeof(size_t));
+        if (starts == NULL)
+            return -1;
+        conn->line_starts = starts;
+        size_t *lens = (size_t *)realloc(conn->line_lens, new_cap * sizeof(size_t));
+        if (lens == NULL)
+            return -1;
+        conn->line_lens = lens;
+        const char **ptrs = (const char **)realloc(conn->line_ptrs, new_cap * sizeof(const char *));
+        if (ptrs == NULL)
+            return -1;
+        conn->line_ptrs = ptrs;
+        conn->line_cap = new_cap;
+    }
+    conn->line_starts[conn->line_count] = start;
+    conn->line_lens[conn->line_count] = len;
+    conn->line_count++;
+    return 0;
+}
+
+// Whether the reply at the head of the queue is complete. A batch that the
+// server refused answers with a single "ERROR: " line instead of one per
+// command; the commands themselves never reply that way.
+static int reply_complete(const MiniRedis *conn, const Pending *head)
+{
+    if (conn->line_count >= head->lines)
+        return 1;
+    return conn->line_count == 1 && conn->line_lens[0] >= 7 &&
+           memcmp(conn->in + conn->line_starts[0], "ERROR: ", 7) == 0;
+}
+
+// Hand every complete reply in the read buffer to its callback
+static int process_input(MiniRedis *conn)
+{
+    size_t consumed = 0;
+    while (conn->scan < conn->in_len)
+    {
+        if (conn->pending_count == 0)
+        {
+            fail_connection(conn, EPROTO); // Bytes nobody asked for
+            return -1;
+        }
+
+        char *newline = (char *)memchr(conn->in + conn->scan, '\n', conn->in_len - conn->scan);
+        if (newline == NULL)
+            break;
+        size_t end = newline - conn->in;
+        if (push_line(conn, conn->scan, end - conn->scan) < 0)
+        {
+            fail_connection(conn, ENOMEM);
+            return -1;
+        }
+        conn->scan = end + 1;
+
+        Pending head = conn->pending[conn->pending_head];
+        if (!reply_complete(conn, &head))
+            continue;
+
+        // Pop before calling back, so the callback may submit more commands
+        conn->pending_head = (conn->pending_head + 1) % conn->pending_cap;
+        conn->pending_count--;
+        for (size_t i = 0; i < conn->line_count; i++)
+            conn->line_ptrs[i] = conn->in + conn->line_starts[i];
+        MiniRedisReply reply = {conn->line_count, conn->line_ptrs, conn->line_lens};
+        conn->line_count = 0;
+        consumed = conn->scan;
+        if (head.cb)
+            head.cb(conn, &reply, head.ctx);
+        if (conn->failed)
+            return -1;
+    }
+
+    // Keep only the bytes of replies still incomplete
+    if (consumed > 0)
+    {
+        memmove(conn->in, conn->in + consumed, conn->in_len - consumed);
+        conn->in_len -= consumed;
+        conn->scan -= consumed;
+        for (size_t i = 0; i < conn->line_count; i++)
+            conn->line_starts[i] -= consumed;
+    }
+    return 0;
+}
+
+int miniredis_on_readable(MiniRedis *conn)
+{
+    if (conn->failed)
+        return -1;
+
+    for (;;)
+    {
+        if (reserve(&conn->in, &conn->in_cap, conn->in_len + MINIREDIS_READ_SIZE) < 0)
+        {
+            fail_connection(conn, ENOMEM);
+            return -1;
+        }
+        ssize_t n = recv(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len, 0);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            fail_connection(conn, errno);
+            return -1;
+        }
+        if (n == 0)
+        {
+            fail_connection(conn, ECONNRESET);
+            return -1;
+        }
+        conn->in_len += n;
+        if (process_input(conn) < 0)
+            return -1;
+    }
+}
+
+int miniredis_wait(MiniRedis *conn)
+{
+    while (!conn->failed && (conn->pending_count > 0 || miniredis_wants_write(conn)))
+    {
+        if (miniredis_wants_write(conn) && miniredis_on_writable(conn) < 0)
+            return -1;
+        if (conn->pending_count == 0 && !miniredis_wants_write(conn))
+            break;
+
+        struct pollfd pfd = {conn->fd, POLLIN, 0};
+        if (miniredis_wants_write(conn))
+            pfd.events |= POLLOUT;
+        int ready = poll(&pfd, 1, conn->timeout_ms);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+        {
+            // Replies that arrive later could not be matched to commands
+            fail_connection(conn, ready == 0 ? ETIMEDOUT : errno);
+            return -1;
+        }
+        if ((pfd.revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) && miniredis_on_readable(conn) < 0)
+            return -1;
+    }
+    if (conn->failed)
+    {
+        errno = conn->error;
+        return -1;
+    }
+    return 0;
+}
+
+// Decode four hex digits of a \u escape
+static int parse_hex4(const char *p, unsigned *out)
+{
+    unsigned v = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9')
+            v |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            v |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+// Write a code point as UTF-8
+static char *put_utf8(char *p, unsigned cp)
+{
+    if (cp < 0x80)
+        *p++ = (char)cp;
+    else if (cp < 0x800)
+    {
+        *p++ = (char)(0xc0 | (cp >> 6));
+        *p++ = (char)(0x80 | (cp & 0x3f));
+    }
+    else if (cp < 0x10000)
+    {
+        *p++ = (char)(0xe0 | (cp >> 12));
+        *p++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+        *p++ = (char)(0x80 | (cp & 0x3f));
+    }
+    else
+    {
+        *p++ = (char)(0xf0 | (cp >> 18));
+        *p++ = (char)(0x80 | ((cp >> 12) & 0x3f));
+        *p++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+        *p++ = (char)(0x80 | (cp & 0x3f));
+    }
+    return p;
+}
+
+// Decode the JSON string literal s[0..len), quotes included, into out, which
+// has room for len bytes
+// Returns: decoded length, or -1 if the literal is malformed
+static long unescape_string(const char *s, size_t len, char *out)
+{
+    char *p = out;
+    size_t i = 1;
+    while (i < len - 1)
+    {
+        char c = s[i++];
+        if (c != '\\')
+        {
+            *p++ = c;
+            continue;
+        }
+        if (i >= len - 1)
+            return -1;
+        c = s[i++];
+        switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            *p++ = c;
+            break;
+        case 'b':
+            *p++ = '\b';
+            break;
+        case 'f':
+            *p++ = '\f';
+            break;
+        case 'n':
+            *p++ = '\n';
+            break;
+        case 'r':
+            *p++ = '\r';
+            break;
+        case 't':
+            *p++ = '\t';
+            break;
+        case 'u':
+        {
+            unsigned cp, low;
+            if (i + 4 > len - 1 || parse_hex4(s + i, &cp) < 0)
+                return -1;
+            i += 4;
+            // A high surrogate is followed by the low half of the pair
+            if (cp >= 0xd800 && cp < 0xdc00 && i + 6 <= len - 1 && s[i] == '\\' && s[i + 1] == 'u' &&
+                parse_hex4(s + i + 2, &low) == 0 && low >= 0xdc00 && low < 0xe000)
+            {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                i += 6;
+            }
+            p = put_utf8(p, cp);
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+    return p - out;
+}
+
+int miniredis_parse_value(const char *line, size_t len, char **value, size_t *value_len)
+{
+    if (len == 9 && memcmp(line, "Not Found", 9) == 0)
+        return 0;
+    if (len == 0 || (len >= 5 && memcmp(line, "ERROR", 5) == 0))
+        return -1;
+
+    // Strings are returned decoded, other JSON values as their text
+    char *out = (char *)malloc(len + 1);
+    if (out == NULL)
+        return -1;
+    long out_len = (long)len;
+    if (line[0] == '"' && len >= 2 && line[len - 1] == '"')
+    {
+        if (memchr(line, '\\', len) == NULL)
+        {
+            out_len = (long)len - 2;
+            memcpy(out, line + 1, out_len);
+        }
+        else if ((out_len = unescape_string(line, len, out)) < 0)
+        {
+            free(out);
+            return -1;
+        }
+    }
+    else
+        memcpy(out, line, len);
+
+    out[out_len] = '\0';
+    *value = out;
+    if (value_len)
+        *value_len = (size_t)out_len;
+    return 1;
+}
+
+// Reply of a blocking call
+typedef struct
+{
+    int result;
+    char **values;
+    size_t *value_len;
+    size_t count;
+} SyncReply;
+
+static void get_done(MiniRedis *conn, const MiniRedisReply *reply, void *ctx)
+{
+    (void)conn;
+    SyncReply *sync = (SyncReply *)ctx;
+    if (reply)
+        sync->result = miniredis_parse_value(reply->lines[0], reply->lengths[0], sync->values, sync->value_len);
+}
+
+static void set_done(MiniRedis *conn, const MiniRedisReply *reply, void *ctx)
+{
+    (void)conn;
+    SyncReply *sync = (SyncReply *)ctx;
+    if (reply)
+    {
+        sync->result = 0;
+        for (size_t i = 0; i < reply->count; i++)
+            if (reply->count < sync->count || reply->lengths[i] != 2 || memcmp(reply->lines[i], "OK", 2) != 0)
+                sync->result = -1;
+    }
+}
+
+static void del_done(MiniRedis *conn, const MiniRedisReply *reply, void *ctx)
+{
+    (void)conn;
+    SyncReply *sync = (SyncReply *)ctx;
+    if (reply && reply->lengths[0] == 7 && memcmp(reply->lines[0], "Deleted", 7) == 0)
+        sync->result = 1;
+    else if (reply && reply->lengths[0] == 9 && memcmp(reply->lines[0], "Not Found", 9) == 0)
+        sync->result = 0;
+}
+
+static void mget_done(MiniRedis *conn, const MiniRedisReply *reply, void *ctx)
+{
+    (void)conn;
+    SyncReply *sync = (SyncReply *)ctx;
+    if (reply == NULL || reply->count < sync->count)
+        return;
+
+    for (size_t i = 0; i < sync->count; i++)
+    {
+        sync->values[i] = NULL;
+        if (miniredis_parse_value(reply->lines[i], reply->lengths[i], &sync->values[i], NULL) < 0)
+        {
+            for (size_t j = 0; j < i; j++)
+            {
+                free(sync->values[j]);
+                sync->values[j] = NULL;
+            }
+            return;
+        }
+    }
+    sync->result = 0;
+}
+
+int miniredis_get(MiniRedis *conn, const char *key, char **value, size_t *value_len)
+{
+    SyncReply sync = {-1, value, value_len, 1};
+    if (miniredis_submit_get(conn, key, get_done, &sync) < 0 || miniredis_wait(conn) < 0)
+        return -1;
+    return sync.result;
+}
+
+int miniredis_set(MiniRedis *conn, const char *key, const char *value)
+{
+    SyncReply sync = {-1, NULL, NULL, 1};
+    if (miniredis_submit_set(conn, key, value, strlen(value), set_done, &sync) < 0 || miniredis_wait(conn) < 0)
+        return -1;
+    return sync.result;
+}
+
+int miniredis_del(MiniRedis *conn, const char *key)
+{
+    SyncReply sync = {-1, NULL, NULL, 1};
+    if (miniredis_submit_del(conn, key, del_done, &sync) < 0 || miniredis_wait(conn) < 0)
+        return -1;
+    return sync.result;
+}
+
+int miniredis_mget(MiniRedis *conn, const char *const *keys, size_t count, char **values)
+{
+    if (count == 0)
+        return 0;
+    SyncReply sync = {-1, values, NULL, count};
+    if (miniredis_submit_mget(conn, keys, count, mget_done, &sync) < 0 || miniredis_wait(conn) < 0)
+        return -1;
+    return sync.result;
+}
+
+int miniredis_mset(MiniRedis *conn, const char *const *keys, const char *const *values, size_t count)
+{
+    if (count == 0)
+        return 0;
+    SyncReply sync = {-1, NULL, NULL, count};
+    if (miniredis_submit_mset(conn, keys, values, count, set_done, &sync) < 0 || miniredis_wait(conn) < 0)
+        return -1;
+    return sync.result;
+}
+
+MiniRedisPool *miniredis_pool_create(const char *host, int port, size_t max_connections)
+{
+    if (max_connections == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    MiniRedisPool *pool = (MiniRedisPool *)calloc(1, sizeof(MiniRedisPool));
+    if (pool == NULL)
+        return NULL;
+    pool->host = strdup(host);
+    pool->idle = (MiniRedis **)calloc(max_connections, sizeof(MiniRedis *));
+    if (pool->host == NULL || pool->idle == NULL)
+    {
+        free(pool->host);
+        free(pool->idle);
+        free(pool);
+        return NULL;
+    }
+    pool->port = port;
+    pool->max_connections = max_connections;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+    return pool;
+}
+
+MiniRedis *miniredis_pool_acquire(MiniRedisPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->idle_count == 0 && pool->open == pool->max_connections)
+        pthread_cond_wait(&pool->available, &pool->lock);
+
+    if (pool->idle_count > 0)
+    {
+        // Most recently released first, its socket buffers are still warm
+        MiniRedis *conn = pool->idle[--pool->idle_count];
+        pthread_mutex_unlock(&pool->lock);
+        return conn;
+    }
+
+    // Connect outside the lock so other threads can take idle connections
+    pool->open++;
+    pthread_mutex_unlock(&pool->lock);
+    MiniRedis *conn = miniredis_connect(pool->host, pool->port);
+    if (conn == NULL)
+    {
+        int error = errno;
+        pthread_mutex_lock(&pool->lock);
+        pool->open--;
+        pthread_cond_signal(&pool->available);
+        pthread_mutex_unlock(&pool->lock);
+        errno = error;
+    }
+    return conn;
+}
+
+void miniredis_pool_release(MiniRedisPool *pool, MiniRedis *conn)
+{
+    // The reply stream of a connection with commands outstanding would be
+    // out of step for its next user
+    int reusable = !conn->failed && conn->pending_count == 0 && !miniredis_wants_write(conn);
+    if (reusable)
+    {
+        miniredis_set_timeout(conn, -1);
+        miniredis_set_write_hook(conn, NULL, NULL);
+    }
+    else
+        miniredis_close(conn);
+
+    pthread_mutex_lock(&pool->lock);
+    if (reusable)
+        pool->idle[pool->idle_count++] = conn;
+    else
+        pool->open--;
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void miniredis_pool_destroy(MiniRedisPool *pool)
+{
+    if (pool == NULL)
+        return;
+
+    for (size_t i = 0; i < pool->idle_count; i++)
+        miniredis_close(pool->idle[i]);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->available);
+    free(pool->idle);
+    free(pool->host);
+    free(pool);
+}
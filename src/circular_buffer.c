@@ -13,19 +13,36 @@ void buffer_init(CircularBuffer *buf, size_t size)
 
 void buffer_write(CircularBuffer *buf, const char *data)
 {
-    size_t len = strlen(data);
-    for (size_t i = 0; i < len; i++)
+    buffer_write_len(buf, data, strlen(data));
+}
+
+// Append len bytes, overwriting the oldest data once the buffer is full
+void buffer_write_len(CircularBuffer *buf, const char *data, size_t len)
+{
+    if (len >= buf->size)
+    {
+        // Only the newest size bytes survive
+        data += len - buf->size;
+        len = buf->size;
+    }
+    while (len > 0)
+    {
+        size_t chunk = buf->size - buf->head;
+        if (chunk > len)
+            chunk = len;
+        memcpy(buf->buffer + buf->head, data, chunk);
+        buf->head = (buf->head + chunk) % buf->size;
+        data += chunk;
+        len -= chunk;
+        buf->count += chunk;
+    }
+    if (buf->count > buf->size)
     {
-        buf->buffer[buf->head] = data[i];
-        buf->head = (buf->head + 1) % buf->size;
-        if (buf->count == buf->size)
-        {
-            buf->tail = (buf->tail + 1) % buf->size; // Write the oldest data if the buffer is full
-        }
-        else
-        {
-            buf->count++;
-        }
+        buf->count = buf->size;
+    }
+    if (buf->count == buf->size)
+    {
+        buf->tail = buf->head; // The oldest data was overwritten
     }
 }
 
@@ -40,3 +57,20 @@ void buffer_read(CircularBuffer *buf, char *output, size_t len)
     }
     output[i] = '\0'; // Add null terminator
 }
+
+// Copy up to len bytes starting skip bytes past the oldest, without consuming them
+size_t buffer_peek(const CircularBuffer *buf, size_t skip, char *output, size_t len)
+{
+    if (skip >= buf->count)
+        return 0;
+    if (len > buf->count - skip)
+        len = buf->count - skip;
+
+    size_t start = (buf->tail + skip) % buf->size;
+    size_t chunk = buf->size - start;
+    if (chunk > len)
+        chunk = len;
+    memcpy(output, buf->buffer + start, chunk);
+    memcpy(output + chunk, buf->buffer, len - chunk);
+    return len;
+}
@@ -0,0 +1,154 @@
+// client.c - Client connection state for the Mini-Redis project
+// This file tracks persistent connections, splits the byte stream into JSON
+// commands and hands each complete command to the server for execution.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <json-c/json.h>
+#include "client.h"
+#include "server.h"
+#include "pubsub.h"
+#include "repl.h"
+#include "multi.h"
+#include "config.h"
+#include "log.h"
+
+// All connected clients
+static Client *clients = NULL;
+
+// Create a client for a connected socket
+Client *client_create(int fd)
+{
+    Client *client = (Client *)calloc(1, sizeof(Client));
+    if (client == NULL)
+        return NULL;
+
+    client->tok = json_tokener_new();
+    if (client->tok == NULL)
+    {
+        free(client);
+        return NULL;
+    }
+    client->fd = fd;
+    reply_queue_init(&client->out);
+
+    client->next = clients;
+    if (clients)
+        clients->prev = client;
+    clients = client;
+    return client;
+}
+
+// Remove a client from the client list and free it
+void client_free(Client *client)
+{
+    if (client->prev)
+        client->prev->next = client->next;
+    else
+        clients = client->next;
+    if (client->next)
+        client->next->prev = client->prev;
+
+    pubsub_client_free(client);
+    repl_client_free(client);
+    multi_client_free(client);
+    reply_queue_free(&client->out);
+    json_tokener_free(client->tok);
+    free(client->backend);
+    free(client);
+}
+
+// Queue an error reply and close the connection once it has been written
+void client_fail(Client *client, const char *message)
+{
+    reply_add(&client->out, message, strlen(message));
+    client->flags |= CLIENT_CLOSE_AFTER_REPLY;
+}
+
+// Feed received bytes to a client, executing every complete command
+int client_feed(Client *client, const char *data, size_t len)
+{
+    if (client->flags & (CLIENT_CLOSE_AFTER_REPLY | CLIENT_CLOSING | CLIENT_CLOSED))
+        return -1;
+
+    while (len > 0)
+    {
+        struct json_object *command = json_tokener_parse_ex(client->tok, data, len);
+        enum json_tokener_error jerr = json_tokener_get_error(client->tok);
+
+        if (jerr == json_tokener_continue)
+        {
+            // The rest of the command has not arrived yet
+            client->request_bytes += len;
+            if (client->request_bytes > MAX_REQUEST_SIZE)
+            {
+                log_error("Command exceeds %d bytes\n", MAX_REQUEST_SIZE);
+                client_fail(client, "ERROR: Command too large\n");
+                return -1;
+            }
+            return 0;
+        }
+        if (jerr != json_tokener_success || command == NULL)
+        {
+            // The stream cannot be resynchronized after malformed input
+            log_error("Failed to parse JSON: %s\n", json_tokener_error_desc(jerr));
+            json_object_put(command);
+            client_fail(client, "ERROR: Invalid JSON\n");
+            return -1;
+        }
+
+        size_t used = json_tokener_get_parse_end(client->tok);
+        json_tokener_reset(client->tok);
+        client->command_bytes = client->request_bytes + used;
+        client->request_bytes = 0;
+        data += used;
+        len -= used;
+
+        execute_command(client, command);
+        json_object_put(command);
+    }
+    return 0;
+}
+
+// Whether the client has output waiting to be written
+int client_has_output(const Client *client)
+{
+    return client->out.bytes > 0;
+}
+
+// Queue more output for a client whose output is produced as it drains
+int client_refill(Client *client)
+{
+    if (client->snapshot)
+        return repl_refill(client);
+    return 0;
+}
+
+// Whether the backend should read more commands from the client
+int client_can_read(Client *client)
+{
+    if (client->flags & CLIENT_READ_PAUSED)
+    {
+        if (client->out.bytes >= CLIENT_OUTPUT_LOW_WATER)
+            return 0;
+        client->flags &= ~CLIENT_READ_PAUSED;
+    }
+    else if (client->out.bytes >= CLIENT_OUTPUT_HIGH_WATER)
+    {
+        client->flags |= CLIENT_READ_PAUSED;
+        return 0;
+    }
+    return 1;
+}
+
+// Free every client and close their sockets
+void client_free_all(void)
+{
+    while (clients)
+    {
+        close(clients->fd);
+        client_free(clients);
+    }
+}
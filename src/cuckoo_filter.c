@@ -0,0 +1,181 @@
+// cuckoo_filter.c - Cuckoo filter for the Mini-Redis project
+// This file implements a partial-key cuckoo filter: each key is reduced to a
+// 16-bit fingerprint stored in one of two buckets, where the second bucket
+// can be derived from the first and the fingerprint alone.
+
+#include <stdlib.h>
+#include <string.h>
+#include "cuckoo_filter.h"
+
+// 64-bit FNV-1a followed by a murmur3 finalizer to spread the bits
+static uint64_t hash_key(const char *key, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)key[i];
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Fingerprint from the high bits, never 0 since 0 marks an empty slot
+static uint16_t fingerprint(uint64_t hash)
+{
+    uint16_t fp = (uint16_t)(hash >> 48);
+    return fp ? fp : 1;
+}
+
+// The other bucket a fingerprint may live in. XOR makes this symmetric.
+static size_t alt_index(const CuckooFilter *filter, size_t index, uint16_t fp)
+{
+    return (index ^ (fp * 0x5bd1e995ULL)) & (filter->num_buckets - 1);
+}
+
+static int bucket_add(CuckooFilter *filter, size_t index, uint16_t fp)
+{
+    uint16_t *bucket = filter->buckets[index];
+    for (int i = 0; i < CUCKOO_BUCKET_SIZE; i++)
+    {
+        if (bucket[i] == 0)
+        {
+            bucket[i] = fp;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int bucket_has(const CuckooFilter *filter, size_t index, uint16_t fp)
+{
+    const uint16_t *bucket = filter->buckets[index];
+    for (int i = 0; i < CUCKOO_BUCKET_SIZE; i++)
+    {
+        if (bucket[i] == fp)
+            return 1;
+    }
+    return 0;
+}
+
+static int bucket_remove(CuckooFilter *filter, size_t index, uint16_t fp)
+{
+    uint16_t *bucket = filter->buckets[index];
+    for (int i = 0; i < CUCKOO_BUCKET_SIZE; i++)
+    {
+        if (bucket[i] == fp)
+        {
+            bucket[i] = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Allocate a filter with room for at least `capacity` keys
+int cuckoo_init(CuckooFilter *filter, size_t capacity)
+{
+    size_t needed = (capacity + CUCKOO_BUCKET_SIZE - 1) / CUCKOO_BUCKET_SIZE;
+    size_t num_buckets = 1;
+    while (num_buckets < needed)
+        num_buckets <<= 1;
+
+    filter->buckets = calloc(num_buckets, sizeof(*filter->buckets));
+    if (filter->buckets == NULL)
+        return -1;
+    filter->num_buckets = num_buckets;
+    filter->count = 0;
+    filter->rng = 0x9e3779b97f4a7c15ULL;
+    return 0;
+}
+
+// Release the filter's memory
+void cuckoo_free(CuckooFilter *filter)
+{
+    free(filter->buckets);
+    filter->buckets = NULL;
+    filter->num_buckets = 0;
+    filter->count = 0;
+}
+
+// Forget every key, keeping the allocated buckets
+void cuckoo_clear(CuckooFilter *filter)
+{
+    memset(filter->buckets, 0, filter->num_buckets * sizeof(*filter->buckets));
+    filter->count = 0;
+}
+
+// Add a key, relocating existing fingerprints when both buckets are full
+int cuckoo_insert(CuckooFilter *filter, const char *key, size_t len)
+{
+    uint64_t hash = hash_key(key, len);
+    uint16_t fp = fingerprint(hash);
+    size_t i1 = hash & (filter->num_buckets - 1);
+    size_t i2 = alt_index(filter, i1, fp);
+
+    if (bucket_add(filter, i1, fp) || bucket_add(filter, i2, fp))
+    {
+        filter->count++;
+        return 0;
+    }
+
+    size_t index = (hash >> 32) & 1 ? i1 : i2;
+    for (int kick = 0; kick < CUCKOO_MAX_KICKS; kick++)
+    {
+        // xorshift64 to pick the victim slot
+        filter->rng ^= filter->rng << 13;
+        filter->rng ^= filter->rng >> 7;
+        filter->rng ^= filter->rng << 17;
+        int slot = filter->rng % CUCKOO_BUCKET_SIZE;
+
+        uint16_t victim = filter->buckets[index][slot];
+        filter->buckets[index][slot] = fp;
+        fp = victim;
+        index = alt_index(filter, index, fp);
+        if (bucket_add(filter, index, fp))
+        {
+            filter->count++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Check whether a key may have been inserted
+int cuckoo_contains(const CuckooFilter *filter, const char *key, size_t len)
+{
+    uint64_t hash = hash_key(key, len);
+    uint16_t fp = fingerprint(hash);
+    size_t i1 = hash & (filter->num_buckets - 1);
+    return bucket_has(filter, i1, fp) || bucket_has(filter, alt_index(filter, i1, fp), fp);
+}
+
+// Remove one fingerprint matching the key
+int cuckoo_delete(CuckooFilter *filter, const char *key, size_t len)
+{
+    uint64_t hash = hash_key(key, len);
+    uint16_t fp = fingerprint(hash);
+    size_t i1 = hash & (filter->num_buckets - 1);
+    if (bucket_remove(filter, i1, fp) || bucket_remove(filter, alt_index(filter, i1, fp), fp))
+    {
+        filter->count--;
+        return 0;
+    }
+    return -1;
+}
+
+// Number of fingerprint slots
+size_t cuckoo_capacity(const CuckooFilter *filter)
+{
+    return filter->num_buckets * CUCKOO_BUCKET_SIZE;
+}
+
+// Bytes used by the bucket array
+size_t cuckoo_memory(const CuckooFilter *filter)
+{
+    return filter->num_buckets * sizeof(*filter->buckets);
+}
@@ -1,37 +1,120 @@
 // database.c - Implementation of the in-memory database using an AVL tree
 
 #include "database.h"
+#include "cuckoo_filter.h"
+#include "lazyfree.h"
 #include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <json-c/json.h>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+// Nodes freed between pauses that let the server thread release values
+#define LAZYFREE_BATCH 1024
+
+// Deepest tree a SCAN can walk; an AVL tree this tall holds over 2^40 keys
+#define SCAN_STACK_DEPTH 64
 
 // Function prototypes for AVL tree operations
 static void free_node(KeyValue *node);
 static void free_tree(KeyValue *node);
+static void free_tree_batched(KeyValue *node, size_t *freed);
+static void free_tree_job(void *arg);
+static void free_value_job(void *arg);
 static int height(KeyValue *node);
 static int max(int a, int b);
-static KeyValue *create_node(const char *key, json_object *value);
+static int value_flags(json_object *value);
+static void encode_value(KeyValue *entry, json_object *value);
+static void copy_value(KeyValue *dst, const KeyValue *src);
+static void swap_value(KeyValue *a, KeyValue *b);
+static void count_value(const KeyValue *node, int sign);
+static KeyValue *create_node(const char *key, const KeyValue *entry);
 static KeyValue *right_rotate(KeyValue *y);
 static KeyValue *left_rotate(KeyValue *x);
 static int get_balance(KeyValue *node);
-static KeyValue *insert(KeyValue *node, const char *key, json_object *value);
+static KeyValue *insert(KeyValue *node, const char *key, const KeyValue *entry, int *created);
 static KeyValue *min_value_node(KeyValue *node);
-static KeyValue *delete_node(KeyValue *node, const char *key);
+static KeyValue *delete_node(KeyValue *node, const char *key, int *deleted, KeyValue *removed);
+static size_t key_length(const char *key);
+static int filter_add_tree(KeyValue *node);
+static void filter_rebuild(size_t capacity);
 
 // Root of the AVL tree
 static KeyValue *root = NULL;
+static size_t key_count = 0;
+
+// Optional filter of stored keys, so most misses skip the tree walk
+static CuckooFilter filter;
+static int filter_enabled = 0;
+static unsigned long long filter_lookups = 0;         // Lookups that consulted the filter
+static unsigned long long filter_negatives = 0;       // Misses answered by the filter alone
+static unsigned long long filter_false_positives = 0; // Misses the filter let through to the tree
+
+// Optional compression of large values
+static size_t compress_threshold = 0;
+static size_t compressed_values = 0;
+static size_t compressed_bytes = 0;     // Size of compressed values as stored
+static size_t compressed_raw_bytes = 0; // Size of compressed values once decoded
 
 // Initialize the database
 void db_init()
 {
     root = NULL;
+    key_count = 0;
 }
 
-// Retrieve a value from the database
-json_object *db_get(const char *key)
+// Keep a cuckoo filter of stored keys in front of the tree
+int db_enable_filter(size_t capacity)
+{
+    if (filter_enabled)
+        return 0;
+    if (key_count > capacity)
+        capacity = key_count;
+    filter_enabled = 1;
+    filter_rebuild(capacity);
+    return filter_enabled ? 0 : -1;
+}
+
+// Drop the key filter
+void db_disable_filter()
 {
+    if (!filter_enabled)
+        return;
+    cuckoo_free(&filter);
+    filter_enabled = 0;
+    filter_lookups = 0;
+    filter_negatives = 0;
+    filter_false_positives = 0;
+}
+
+// Compress large string values from now on
+int db_enable_compression(size_t threshold)
+{
+#ifdef HAVE_LZ4
+    compress_threshold = threshold;
+    return 0;
+#else
+    (void)threshold;
+    return -1;
+#endif
+}
+
+// Retrieve the node holding a key
+const KeyValue *db_lookup(const char *key)
+{
+    if (filter_enabled)
+    {
+        filter_lookups++;
+        if (!cuckoo_contains(&filter, key, key_length(key)))
+        {
+            filter_negatives++;
+            return NULL; // Key not found
+        }
+    }
+
     KeyValue *current = root;
     while (current)
     {
@@ -41,33 +124,238 @@ json_object *db_get(const char *key)
         else if (cmp > 0)
             current = current->right;
         else
-            return current->value; // Key found, return the JSON object
+            return current; // Key found
     }
-    log_info("Key not found: %s", key);
+    if (filter_enabled)
+        filter_false_positives++;
     return NULL; // Key not found
 }
 
+// Retrieve a value from the database
+json_object *db_get(const char *key)
+{
+    const KeyValue *node = db_lookup(key);
+    return node ? node->value : NULL;
+}
+
+// Decompress a node's encoded value
+int db_decode(const KeyValue *node, char *out)
+{
+#ifdef HAVE_LZ4
+    if (node->encoding == VALUE_ENCODING_LZ4)
+    {
+        int len = LZ4_decompress_safe(json_object_get_string(node->value), out,
+                                      json_object_get_string_len(node->value), (int)node->raw_len);
+        return len == (int)node->raw_len ? 0 : -1;
+    }
+#else
+    (void)node;
+    (void)out;
+#endif
+    return -1;
+}
+
+// Get a node's value as it was set
+json_object *db_decode_value(const KeyValue *node)
+{
+    if (node->encoding == VALUE_ENCODING_RAW)
+        return json_object_get(node->value);
+
+    char *buf = (char *)malloc(node->raw_len + 1);
+    json_object *value = NULL;
+    if (buf && db_decode(node, buf) == 0)
+        value = json_object_new_string_len(buf, (int)node->raw_len);
+    free(buf);
+    return value;
+}
+
 // Insert or update a key-value pair in the database
 int db_set(const char *key, json_object *value)
 {
-    root = insert(root, key, value);
+    KeyValue entry;
+    encode_value(&entry, value);
+    count_value(&entry, 1);
+
+    int created = 0;
+    root = insert(root, key, &entry, &created);
+    if (created)
+    {
+        key_count++;
+        // A full filter has displaced some other key, so start over bigger
+        if (filter_enabled && cuckoo_insert(&filter, key, key_length(key)) == -1)
+            filter_rebuild(cuckoo_capacity(&filter) * 2);
+    }
     return 0;
 }
 
+// Remove a key from the tree and the filter
+// Returns: the removed value, NULL if the key was not stored
+static json_object *detach(const char *key, int *deleted)
+{
+    KeyValue removed;
+    removed.value = NULL;
+    *deleted = 0;
+    root = delete_node(root, key, deleted, &removed);
+    if (*deleted)
+    {
+        key_count--;
+        count_value(&removed, -1);
+        // Only keys that were stored may be removed, or another key sharing
+        // the fingerprint would disappear from the filter
+        if (filter_enabled)
+            cuckoo_delete(&filter, key, key_length(key));
+    }
+    return removed.value;
+}
+
 // Delete a key-value pair from the database
 int db_delete(const char *key)
 {
     if (key == NULL)
         return -1;
-    root = delete_node(root, key);
+
+    int deleted;
+    json_object_put(detach(key, &deleted));
+    return deleted ? 0 : -1;
+}
+
+// Delete a key, freeing a large value on the lazyfree thread
+int db_unlink(const char *key)
+{
+    if (key == NULL)
+        return -1;
+
+    int deleted;
+    json_object *value = detach(key, &deleted);
+    if (value == NULL)
+        return deleted ? 0 : -1;
+    // Compressed values are strings too, so their stored size decides
+    if (json_object_is_type(value, json_type_string) && json_object_get_string_len(value) < LAZYFREE_THRESHOLD)
+        json_object_put(value); // Cheaper than a trip to the other thread
+    else
+        lazyfree_submit(free_value_job, value, 1);
+    return 0;
+}
+
+// Visit up to count keys that sort after a cursor. The walk keeps only the
+// path to the next key, so each call costs O(log n + count) no matter how
+// the tree has been rebalanced since the cursor was handed out.
+int db_scan(const char *after, size_t count, void (*fn)(const KeyValue *node, void *ctx), void *ctx)
+{
+    KeyValue *stack[SCAN_STACK_DEPTH];
+    int depth = 0;
+
+    // Stack the nodes on the cursor's search path that sort after it; the
+    // top of the stack is the first key to visit
+    KeyValue *node = root;
+    while (node)
+    {
+        if (after == NULL || strcmp(node->key, after) > 0)
+        {
+            stack[depth++] = node;
+            node = node->left;
+        }
+        else
+        {
+            node = node->right;
+        }
+    }
+
+    size_t visited = 0;
+    while (depth > 0)
+    {
+        if (visited == count)
+            return 1;
+        node = stack[--depth];
+        fn(node, ctx);
+        visited++;
+        for (KeyValue *next = node->right; next; next = next->left)
+            stack[depth++] = next;
+    }
     return 0;
 }
 
+// Report key and filter statistics
+void db_stats(DbStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->keys = key_count;
+    stats->compress_threshold = compress_threshold;
+    stats->compressed_values = compressed_values;
+    stats->compressed_bytes = compressed_bytes;
+    stats->compressed_raw_bytes = compressed_raw_bytes;
+    stats->filter_enabled = filter_enabled;
+    if (!filter_enabled)
+        return;
+
+    stats->filter_capacity = cuckoo_capacity(&filter);
+    stats->filter_items = filter.count;
+    stats->filter_bytes = cuckoo_memory(&filter);
+    stats->filter_lookups = filter_lookups;
+    stats->filter_negatives = filter_negatives;
+    stats->filter_false_positives = filter_false_positives;
+}
+
+// Remove every key, handing the old tree to the lazyfree thread if async
+void db_flush(int async)
+{
+    KeyValue *old = root;
+    size_t count = key_count;
+    root = NULL;
+    key_count = 0;
+    compressed_values = 0;
+    compressed_bytes = 0;
+    compressed_raw_bytes = 0;
+    if (filter_enabled)
+        cuckoo_clear(&filter);
+
+    if (async && old)
+        lazyfree_submit(free_tree_job, old, count);
+    else
+        free_tree(old);
+}
+
 // Clean up the entire database
 void db_cleanup()
 {
-    free_tree(root);
-    root = NULL;
+    db_flush(0);
+}
+
+// Length of a key as stored in a node
+static size_t key_length(const char *key)
+{
+    return strnlen(key, MAX_KEY_SIZE - 1);
+}
+
+// Add every key in a subtree to the filter
+// Returns: 0 on success, -1 if the filter filled up
+static int filter_add_tree(KeyValue *node)
+{
+    if (node == NULL)
+        return 0;
+    if (cuckoo_insert(&filter, node->key, strlen(node->key)) == -1)
+        return -1;
+    if (filter_add_tree(node->left) == -1)
+        return -1;
+    return filter_add_tree(node->right);
+}
+
+// Refill the filter from the tree, doubling its size until every key fits
+static void filter_rebuild(size_t capacity)
+{
+    while (1)
+    {
+        cuckoo_free(&filter);
+        if (cuckoo_init(&filter, capacity) == -1)
+        {
+            log_error("Failed to allocate key filter, disabling it");
+            filter_enabled = 0;
+            return;
+        }
+        if (filter_add_tree(root) == 0)
+            return;
+        capacity = cuckoo_capacity(&filter) * 2;
+    }
 }
 
 // Free memory for a single node
@@ -88,6 +376,39 @@ static void free_tree(KeyValue *node)
     }
 }
 
+// Free a subtree, pausing every LAZYFREE_BATCH nodes so the server thread
+// can take the lock it needs to drop its own references to values
+static void free_tree_batched(KeyValue *node, size_t *freed)
+{
+    if (node == NULL)
+        return;
+    free_tree_batched(node->left, freed);
+    free_tree_batched(node->right, freed);
+    free_node(node);
+    if (++*freed % LAZYFREE_BATCH == 0)
+    {
+        lazyfree_unlock();
+        lazyfree_lock();
+    }
+}
+
+// Lazyfree work: free a tree detached by db_flush
+static void free_tree_job(void *arg)
+{
+    size_t freed = 0;
+    lazyfree_lock();
+    free_tree_batched((KeyValue *)arg, &freed);
+    lazyfree_unlock();
+}
+
+// Lazyfree work: free a value detached by db_unlink
+static void free_value_job(void *arg)
+{
+    lazyfree_lock();
+    json_object_put((json_object *)arg);
+    lazyfree_unlock();
+}
+
 // Get the height of a node
 static int height(KeyValue *node)
 {
@@ -102,13 +423,105 @@ static int max(int a, int b)
     return (a > b) ? a : b;
 }
 
+// Work out the flags for a value. A string is plain when json-c would emit it
+// verbatim between quotes, which lets replies point straight at its bytes.
+static int value_flags(json_object *value)
+{
+    if (!json_object_is_type(value, json_type_string))
+        return 0;
+
+    const unsigned char *s = (const unsigned char *)json_object_get_string(value);
+    int len = json_object_get_string_len(value);
+    for (int i = 0; i < len; i++)
+    {
+        if (s[i] < 0x20 || s[i] == '"' || s[i] == '\\' || s[i] == '/')
+            return 0;
+    }
+    return VALUE_FLAG_PLAIN;
+}
+
+// Work out how to store a value. Large strings are compressed when that
+// saves at least an eighth of their size; values that barely shrink are kept
+// as they are so reads skip the decompression.
+static void encode_value(KeyValue *entry, json_object *value)
+{
+    entry->value = value;
+    entry->flags = value_flags(value);
+    entry->encoding = VALUE_ENCODING_RAW;
+    entry->raw_len = 0;
+
+#ifdef HAVE_LZ4
+    if (compress_threshold == 0 || !json_object_is_type(value, json_type_string))
+        return;
+    int len = json_object_get_string_len(value);
+    if ((size_t)len < compress_threshold)
+        return;
+
+    int bound = LZ4_compressBound(len);
+    char *buf = (char *)malloc(bound);
+    if (buf == NULL)
+        return;
+    int compressed_len = LZ4_compress_default(json_object_get_string(value), buf, len, bound);
+    if (compressed_len > 0 && compressed_len <= len - len / 8)
+    {
+        json_object *compressed = json_object_new_string_len(buf, compressed_len);
+        if (compressed)
+        {
+            json_object_put(value);
+            entry->value = compressed;
+            entry->encoding = VALUE_ENCODING_LZ4;
+            entry->raw_len = len;
+        }
+    }
+    free(buf);
+#endif
+}
+
+// Copy the value fields of a node
+static void copy_value(KeyValue *dst, const KeyValue *src)
+{
+    dst->value = src->value;
+    dst->flags = src->flags;
+    dst->encoding = src->encoding;
+    dst->raw_len = src->raw_len;
+}
+
+// Exchange the value fields of two nodes
+static void swap_value(KeyValue *a, KeyValue *b)
+{
+    KeyValue tmp;
+    copy_value(&tmp, a);
+    copy_value(a, b);
+    copy_value(b, &tmp);
+}
+
+// Add a value to, or with sign -1 remove it from, the compression totals
+static void count_value(const KeyValue *node, int sign)
+{
+    if (node->encoding == VALUE_ENCODING_RAW)
+        return;
+    size_t len = json_object_get_string_len(node->value);
+    if (sign > 0)
+    {
+        compressed_values++;
+        compressed_bytes += len;
+        compressed_raw_bytes += node->raw_len;
+    }
+    else
+    {
+        compressed_values--;
+        compressed_bytes -= len;
+        compressed_raw_bytes -= node->raw_len;
+    }
+}
+
 // Create a new node with the given key and value
-static KeyValue *create_node(const char *key, json_object *value)
+static KeyValue *create_node(const char *key, const KeyValue *entry)
 {
     KeyValue *node = (KeyValue *)malloc(sizeof(KeyValue));
     strncpy(node->key, key, MAX_KEY_SIZE - 1);
     node->key[MAX_KEY_SIZE - 1] = '\0';
-    node->value = value;
+    copy_value(node, entry);
     node->left = NULL;
     node->right = NULL;
     node->height = 1;
@@ -154,22 +567,26 @@ static int get_balance(KeyValue *node)
 }
 
 // Insert a new key-value pair into the AVL tree
-static KeyValue *insert(KeyValue *node, const char *key, json_object *value)
+static KeyValue *insert(KeyValue *node, const char *key, const KeyValue *entry, int *created)
 {
     // Perform standard BST insertion
     if (node == NULL)
-        return create_node(key, value);
+    {
+        *created = 1;
+        return create_node(key, entry);
+    }
 
     int cmp = strcmp(key, node->key);
     if (cmp < 0)
-        node->left = insert(node->left, key, value);
+        node->left = insert(node->left, key, entry, created);
     else if (cmp > 0)
-        node->right = insert(node->right, key, value);
+        node->right = insert(node->right, key, entry, created);
     else
     {
         // Key already exists, update the value
+        count_value(node, -1);
         json_object_put(node->value);
-        node->value = value;
+        copy_value(node, entry);
         return node;
     }
 
@@ -214,7 +631,7 @@ static KeyValue *min_value_node(KeyValue *node)
 }
 
 // Delete a node from the AVL tree
-static KeyValue *delete_node(KeyValue *root, const char *key)
+static KeyValue *delete_node(KeyValue *root, const char *key, int *deleted, KeyValue *removed)
 {
     // Perform standard BST delete
     if (root == NULL)
@@ -222,36 +639,41 @@ static KeyValue *delete_node(KeyValue *root, const char *key)
 
     int cmp = strcmp(key, root->key);
     if (cmp < 0)
-        root->left = delete_node(root->left, key);
+        root->left = delete_node(root->left, key, deleted, removed);
     else if (cmp > 0)
-        root->right = delete_node(root->right, key);
+        root->right = delete_node(root->right, key, deleted, removed);
     else
     {
-        // Node to be deleted found
+        // Node to be deleted found; its value goes to the caller
+        *deleted = 1;
 
         // Node with only one child or no child
         if ((root->left == NULL) || (root->right == NULL))
         {
             KeyValue *temp = root->left ? root->left : root->right;
 
+            copy_value(removed, root);
             if (temp == NULL)
             {
-                temp = root;
+                free(root);
                 root = NULL;
             }
             else
+            {
+                // Pull the child up into this node; its value moves with it
                 *root = *temp;
-
-            free_node(temp);
+                free(temp);
+            }
         }
         else
         {
-            // Node with two children
+            // Node with two children: swap values with the in-order successor
+            // so removing the successor's node hands back the deleted value
             KeyValue *temp = min_value_node(root->right);
             strncpy(root->key, temp->key, MAX_KEY_SIZE - 1);
             root->key[MAX_KEY_SIZE - 1] = '\0';
-            root->value = temp->value;
-            root->right = delete_node(root->right, temp->key);
+            swap_value(root, temp);
+            root->right = delete_node(root->right, temp->key, deleted, removed);
         }
     }
 
@@ -0,0 +1,130 @@
+// lazyfree.c - Background freeing for the Mini-Redis project
+// This file runs memory-freeing work, such as dropping a flushed tree, on a
+// helper thread so the server thread does not stall on it.
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "lazyfree.h"
+#include "log.h"
+
+// One piece of queued work
+typedef struct LazyfreeJob
+{
+    void (*fn)(void *arg);
+    void *arg;
+    size_t objects;
+    struct LazyfreeJob *next;
+} LazyfreeJob;
+
+static pthread_t thread;
+static int started = 0; // Only changed on the server thread, so it needs no lock
+static int stopping = 0;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static LazyfreeJob *head = NULL;
+static LazyfreeJob *tail = NULL;
+static size_t pending = 0;
+
+// Held while json-c reference counts of queued values may change
+static pthread_mutex_t refcount_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Run queued work until asked to stop with an empty queue
+static void *lazyfree_main(void *unused)
+{
+    (void)unused;
+    pthread_mutex_lock(&queue_mutex);
+    while (1)
+    {
+        while (head == NULL && !stopping)
+            pthread_cond_wait(&queue_cond, &queue_mutex);
+        if (head == NULL)
+            break;
+
+        LazyfreeJob *job = head;
+        head = job->next;
+        if (head == NULL)
+            tail = NULL;
+        pthread_mutex_unlock(&queue_mutex);
+
+        job->fn(job->arg);
+
+        pthread_mutex_lock(&queue_mutex);
+        pending -= job->objects;
+        free(job);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+    return NULL;
+}
+
+// Queue work for the background thread
+void lazyfree_submit(void (*fn)(void *arg), void *arg, size_t objects)
+{
+    LazyfreeJob *job = (LazyfreeJob *)malloc(sizeof(LazyfreeJob));
+    if (job && !started)
+    {
+        if (pthread_create(&thread, NULL, lazyfree_main, NULL) == 0)
+            started = 1;
+        else
+            log_error("Failed to start the lazyfree thread");
+    }
+    if (job == NULL || !started)
+    {
+        free(job);
+        fn(arg);
+        return;
+    }
+
+    job->fn = fn;
+    job->arg = arg;
+    job->objects = objects;
+    job->next = NULL;
+
+    pthread_mutex_lock(&queue_mutex);
+    if (tail)
+        tail->next = job;
+    else
+        head = job;
+    tail = job;
+    pending += objects;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+// Serialize json-c reference counting with the background thread; free
+// until the thread exists
+void lazyfree_lock(void)
+{
+    if (started)
+        pthread_mutex_lock(&refcount_mutex);
+}
+
+void lazyfree_unlock(void)
+{
+    if (started)
+        pthread_mutex_unlock(&refcount_mutex);
+}
+
+// Number of objects waiting to be freed
+size_t lazyfree_pending(void)
+{
+    if (!started)
+        return 0;
+    pthread_mutex_lock(&queue_mutex);
+    size_t count = pending;
+    pthread_mutex_unlock(&queue_mutex);
+    return count;
+}
+
+// Finish queued work and stop the background thread
+void lazyfree_shutdown(void)
+{
+    if (!started)
+        return;
+    pthread_mutex_lock(&queue_mutex);
+    stopping = 1;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+    pthread_join(thread, NULL);
+    started = 0;
+    stopping = 0;
+}
@@ -11,6 +11,8 @@
 #include "log.h"
 #include <stdbool.h>
 #include "database.h"
+#include "reply.h"
+#include "pubsub.h"
 #include "config.h"
 #include <getopt.h>
 
@@ -18,6 +20,11 @@
 int use_syslog = 0;              // Flag to determine if syslog should be used for logging
 int port = PORT;                 // Port number for the server to listen on
 int log_level = LOG_LEVEL_ERROR; // Current log level
+int use_io_uring = 0;            // Flag to serve connections with io_uring instead of epoll
+int use_key_filter = 0;          // Flag to keep a cuckoo filter in front of the keyspace
+size_t compress_threshold = 0;   // Values at least this large are stored LZ4-compressed (0 disables)
+char *replicaof_host = NULL;     // Primary to replicate from, if any
+int replicaof_port = 0;
 
 // Function prototypes
 void init();
@@ -28,7 +35,7 @@ void parse_arguments(int argc, char *argv[])
 {
     int opt;
 
-    while ((opt = getopt(argc, argv, "p:is")) != -1)
+    while ((opt = getopt(argc, argv, "p:isufc:z:l:r:")) != -1)
     {
         switch (opt)
         {
@@ -41,8 +48,37 @@ void parse_arguments(int argc, char *argv[])
         case 's':
             use_syslog = 1;
             break;
+        case 'u':
+            use_io_uring = 1;
+            break;
+        case 'f':
+            use_key_filter = 1;
+            break;
+        case 'c':
+            compress_threshold = strtoull(optarg, NULL, 10);
+            break;
+        case 'z':
+            zerocopy_threshold = strtoull(optarg, NULL, 10);
+            break;
+        case 'l':
+            pubsub_output_limit = strtoull(optarg, NULL, 10);
+            break;
+        case 'r':
+        {
+            // host:port of the primary
+            char *colon = strrchr(optarg, ':');
+            if (colon == NULL)
+            {
+                fprintf(stderr, "Invalid primary address %s, expected host:port\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            *colon = '\0';
+            replicaof_host = optarg;
+            replicaof_port = atoi(colon + 1);
+            break;
+        }
         default:
-            fprintf(stderr, "Usage: %s [-p port] [-i] [-s]\n", argv[0]);
+            fprintf(stderr, "Usage: %s [-p port] [-i] [-s] [-u] [-f] [-c compress_threshold] [-z zerocopy_threshold] [-l subscriber_output_limit] [-r primary_host:port]\n", argv[0]);
             exit(EXIT_FAILURE);
         }
     }
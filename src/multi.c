@@ -0,0 +1,317 @@
+// multi.c - Transactions for the Mini-Redis project
+// This file implements MULTI/EXEC/DISCARD with WATCH-based optimistic
+// concurrency, and BATCH, which runs an array of commands as one unit.
+// Commands run on the single server thread, so a transaction is atomic as
+// long as its commands run back to back.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <json-c/json.h>
+#include "multi.h"
+#include "server.h"
+#include "repl.h"
+#include "log.h"
+
+// A watched key and the clients watching it
+typedef struct WatchedKey
+{
+    char *key;
+    Client **clients;
+    size_t count;
+    size_t capacity;
+    struct WatchedKey *next;
+} WatchedKey;
+
+// One of a client's watches, linked from Client.watched
+typedef struct ClientWatch
+{
+    WatchedKey *entry;
+    struct ClientWatch *next;
+} ClientWatch;
+
+static WatchedKey *watched_keys[MULTI_TABLE_SIZE];
+static size_t watched_count = 0;
+
+static WatchedKey **bucket_for(const char *key)
+{
+    unsigned int h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return &watched_keys[h % MULTI_TABLE_SIZE];
+}
+
+static WatchedKey *find_entry(const char *key)
+{
+    for (WatchedKey *entry = *bucket_for(key); entry; entry = entry->next)
+    {
+        if (strcmp(entry->key, key) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+// Check that a command may run inside a transaction
+// Returns: NULL if it may, otherwise the error reply
+static const char *check_command(json_object *command)
+{
+    json_object *op_obj = NULL, *key_obj = NULL, *value_obj = NULL;
+    json_object_object_get_ex(command, "operation", &op_obj);
+    json_object_object_get_ex(command, "key", &key_obj);
+    json_object_object_get_ex(command, "value", &value_obj);
+    const char *op = json_object_get_string(op_obj);
+    const char *key = json_object_get_string(key_obj);
+
+    if (op == NULL)
+        return "ERROR: Key or operation missing\n";
+    // EXEC drops the watches before running anything, so a queued UNWATCH
+    // only answers OK
+    if (strcmp(op, "STATS") == 0 || strcmp(op, "UNWATCH") == 0)
+        return NULL;
+
+    int write = strcmp(op, "SET") == 0 || strcmp(op, "DEL") == 0 || strcmp(op, "UNLINK") == 0;
+    if (!write && strcmp(op, "GET") != 0 && strcmp(op, "PUBLISH") != 0)
+        return "ERROR: Command not allowed in a transaction\n";
+    if (key == NULL)
+        return "ERROR: Key or operation missing\n";
+    if ((strcmp(op, "SET") == 0 || strcmp(op, "PUBLISH") == 0) && json_object_get_string(value_obj) == NULL)
+        return "ERROR: Value missing\n";
+    if (write && repl_is_replica())
+        return "ERROR: Read-only replica\n";
+    return NULL;
+}
+
+// Run checked commands back to back; their replies coalesce in the
+// client's output queue and go out in one write
+static void run_commands(Client *client, json_object *commands)
+{
+    size_t count = json_object_array_length(commands);
+    for (size_t i = 0; i < count; i++)
+        execute_command(client, json_object_array_get_idx(commands, i));
+}
+
+// Start queueing a client's commands for EXEC
+void multi_begin(Client *client)
+{
+    if (client->flags & CLIENT_MULTI)
+    {
+        reply_add(&client->out, "ERROR: MULTI calls can not be nested\n", 37);
+        return;
+    }
+    client->multi_commands = json_object_new_array();
+    if (client->multi_commands == NULL)
+    {
+        reply_add(&client->out, "ERROR\n", 6);
+        return;
+    }
+    client->flags |= CLIENT_MULTI;
+    reply_add(&client->out, "OK\n", 3);
+}
+
+// Queue a command inside MULTI
+void multi_queue(Client *client, json_object *command)
+{
+    const char *error = check_command(command);
+    if (error)
+    {
+        client->flags |= CLIENT_DIRTY_EXEC;
+        reply_add(&client->out, error, strlen(error));
+        return;
+    }
+    json_object_array_add(client->multi_commands, json_object_get(command));
+    reply_add(&client->out, "QUEUED\n", 7);
+}
+
+// Leave MULTI, dropping queued commands and watches
+static void multi_reset(Client *client)
+{
+    json_object_put(client->multi_commands);
+    client->multi_commands = NULL;
+    client->flags &= ~(CLIENT_MULTI | CLIENT_DIRTY_CAS | CLIENT_DIRTY_EXEC);
+    multi_unwatch(client);
+}
+
+// Run every queued command, unless the transaction was invalidated
+void multi_exec(Client *client)
+{
+    if (!(client->flags & CLIENT_MULTI))
+    {
+        reply_add(&client->out, "ERROR: EXEC without MULTI\n", 26);
+        return;
+    }
+
+    json_object *commands = json_object_get(client->multi_commands);
+    int flags = client->flags;
+    multi_reset(client);
+
+    if (flags & CLIENT_DIRTY_EXEC)
+        reply_add(&client->out, "ERROR: Transaction discarded because of previous errors\n", 56);
+    else if (flags & CLIENT_DIRTY_CAS)
+        reply_add(&client->out, "ERROR: Transaction aborted, a watched key changed\n", 50);
+    else
+        run_commands(client, commands);
+    json_object_put(commands);
+}
+
+// Drop the queued commands and watches
+void multi_discard(Client *client)
+{
+    if (!(client->flags & CLIENT_MULTI))
+    {
+        reply_add(&client->out, "ERROR: DISCARD without MULTI\n", 29);
+        return;
+    }
+    multi_reset(client);
+    reply_add(&client->out, "OK\n", 3);
+}
+
+// Check every command of a batch, then run them all
+void multi_batch(Client *client, json_object *command)
+{
+    json_object *commands = NULL;
+    if (!json_object_object_get_ex(command, "commands", &commands) ||
+        !json_object_is_type(commands, json_type_array) || json_object_array_length(commands) == 0)
+    {
+        reply_add(&client->out, "ERROR: Batch needs a commands array\n", 36);
+        return;
+    }
+
+    size_t count = json_object_array_length(commands);
+    for (size_t i = 0; i < count; i++)
+    {
+        const char *error = check_command(json_object_array_get_idx(commands, i));
+        if (error)
+        {
+            reply_add(&client->out, error, strlen(error));
+            return;
+        }
+    }
+    run_commands(client, commands);
+}
+
+// Watch a key so EXEC aborts if it changes before then
+void multi_watch(Client *client, const char *key)
+{
+    if (client->flags & CLIENT_MULTI)
+    {
+        reply_add(&client->out, "ERROR: WATCH inside MULTI is not allowed\n", 41);
+        return;
+    }
+
+    WatchedKey *entry = find_entry(key);
+    if (entry)
+    {
+        for (ClientWatch *watch = client->watched; watch; watch = watch->next)
+        {
+            if (watch->entry == entry)
+            {
+                reply_add(&client->out, "OK\n", 3); // Already watched
+                return;
+            }
+        }
+    }
+    else
+    {
+        entry = (WatchedKey *)calloc(1, sizeof(WatchedKey));
+        if (entry == NULL || (entry->key = strdup(key)) == NULL)
+        {
+            free(entry);
+            reply_add(&client->out, "ERROR\n", 6);
+            return;
+        }
+        WatchedKey **bucket = bucket_for(key);
+        entry->next = *bucket;
+        *bucket = entry;
+        watched_count++;
+    }
+
+    ClientWatch *watch = (ClientWatch *)malloc(sizeof(ClientWatch));
+    if (watch && entry->count == entry->capacity)
+    {
+        size_t capacity = entry->capacity ? entry->capacity * 2 : 4;
+        Client **clients = (Client **)realloc(entry->clients, capacity * sizeof(Client *));
+        if (clients)
+        {
+            entry->clients = clients;
+            entry->capacity = capacity;
+        }
+    }
+    if (watch == NULL || entry->count == entry->capacity)
+    {
+        free(watch);
+        reply_add(&client->out, "ERROR\n", 6);
+        return;
+    }
+    entry->clients[entry->count++] = client;
+    watch->entry = entry;
+    watch->next = client->watched;
+    client->watched = watch;
+    reply_add(&client->out, "OK\n", 3);
+}
+
+// Forget every key a client watches
+void multi_unwatch(Client *client)
+{
+    while (client->watched)
+    {
+        ClientWatch *watch = client->watched;
+        WatchedKey *entry = watch->entry;
+        client->watched = watch->next;
+        free(watch);
+
+        for (size_t i = 0; i < entry->count; i++)
+        {
+            if (entry->clients[i] == client)
+            {
+                entry->clients[i] = entry->clients[--entry->count];
+                break;
+            }
+        }
+        if (entry->count == 0)
+        {
+            WatchedKey **link = bucket_for(entry->key);
+            while (*link != entry)
+                link = &(*link)->next;
+            *link = entry->next;
+            watched_count--;
+            free(entry->clients);
+            free(entry->key);
+            free(entry);
+        }
+    }
+}
+
+// Mark clients watching a key as unable to EXEC
+void multi_touch_key(const char *key)
+{
+    if (watched_count == 0)
+        return;
+    WatchedKey *entry = find_entry(key);
+    if (entry == NULL)
+        return;
+    for (size_t i = 0; i < entry->count; i++)
+        entry->clients[i]->flags |= CLIENT_DIRTY_CAS;
+}
+
+// Mark every watching client
+void multi_touch_all(void)
+{
+    if (watched_count == 0)
+        return;
+    for (size_t b = 0; b < MULTI_TABLE_SIZE; b++)
+    {
+        for (WatchedKey *entry = watched_keys[b]; entry; entry = entry->next)
+        {
+            for (size_t i = 0; i < entry->count; i++)
+                entry->clients[i]->flags |= CLIENT_DIRTY_CAS;
+        }
+    }
+}
+
+// Release transaction state of a client that is going away
+void multi_client_free(Client *client)
+{
+    json_object_put(client->multi_commands);
+    client->multi_commands = NULL;
+    multi_unwatch(client);
+}
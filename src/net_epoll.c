@@ -0,0 +1,330 @@
+// net_epoll.c - Readiness-based networking backend for the Mini-Redis project
+// This file serves all client connections from one epoll loop using
+// non-blocking sockets.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "net.h"
+#include "server.h"
+#include "config.h"
+#include "log.h"
+
+#define EPOLL_MAX_EVENTS 256
+
+// Per-connection epoll state
+typedef struct EpollConn
+{
+    uint32_t events;
+    time_t deadline;       // When a lingering close gives up on zerocopy completions
+    struct EpollConn *next; // Next in the lingering or closed list
+    Client *client;
+} EpollConn;
+
+static int epoll_fd = -1;
+static int listen_fd = -1;
+static EpollConn *lingering = NULL; // Closed clients still waiting on zerocopy completions
+static EpollConn *closed = NULL;    // Closed clients, freed after the current batch of events
+static char read_buffer[BUFFER_SIZE];
+
+// Register the listening socket
+static int epoll_init(int server_socket)
+{
+    listen_fd = server_socket;
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+    {
+        log_error("epoll_create1 failed: %s", strerror(errno));
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // The listener is the only entry without a client
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) == -1)
+    {
+        log_error("epoll_ctl failed: %s", strerror(errno));
+        close(epoll_fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void epoll_set_events(Client *client, uint32_t events)
+{
+    EpollConn *conn = (EpollConn *)client->backend;
+    if (conn->events == events)
+        return;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = client;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+    conn->events = events;
+}
+
+// Close a client. While zerocopy sends are in flight the socket stays open,
+// edge-triggered so hangups do not spin, until completions arrive.
+static void epoll_close(Client *client)
+{
+    EpollConn *conn = (EpollConn *)client->backend;
+
+    reply_zerocopy_reap(client->fd, &client->out);
+    if (reply_zerocopy_pending(&client->out))
+    {
+        if (!(client->flags & CLIENT_CLOSING))
+        {
+            client->flags |= CLIENT_CLOSING;
+            shutdown(client->fd, SHUT_WR);
+            epoll_set_events(client, EPOLLET);
+            conn->deadline = time(NULL) + ZEROCOPY_TIMEOUT;
+            conn->next = lingering;
+            lingering = conn;
+        }
+        return;
+    }
+
+    if (client->flags & CLIENT_CLOSING)
+    {
+        EpollConn **link = &lingering;
+        while (*link != conn)
+            link = &(*link)->next;
+        *link = conn->next;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+
+    // Later events in this batch may still point at the client
+    client->flags |= CLIENT_CLOSED;
+    conn->next = closed;
+    closed = conn;
+}
+
+static void epoll_free_closed(void)
+{
+    while (closed)
+    {
+        EpollConn *conn = closed;
+        closed = conn->next;
+        client_free(conn->client);
+    }
+}
+
+// Abort lingering closes whose completions are overdue. Resetting the
+// connection makes the kernel drop any data still queued from our buffers.
+static void epoll_expire(void)
+{
+    time_t now = time(NULL);
+    EpollConn *conn = lingering;
+
+    while (conn)
+    {
+        EpollConn *next = conn->next;
+        if (now >= conn->deadline)
+        {
+            Client *client = conn->client;
+            struct linger lg = {1, 0};
+            log_error("Zerocopy completions timed out, aborting connection");
+            setsockopt(client->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+            reply_zerocopy_complete(&client->out, client->out.zc_issued);
+            epoll_close(client);
+        }
+        conn = next;
+    }
+}
+
+// Write queued output, watching for writability while some remains
+static void epoll_flush(Client *client)
+{
+    int result = reply_flush(client->fd, &client->out);
+
+    // Output made as the queue drains, such as a replica's snapshot, is
+    // written on the next pass so other clients are served in between
+    if (result == 0 && client_refill(client))
+        result = 1;
+    if (result == -1 || (result == 0 && (client->flags & CLIENT_CLOSE_AFTER_REPLY)))
+    {
+        epoll_close(client);
+        return;
+    }
+    // Stop watching for commands while too much output is unsent
+    uint32_t in = client_can_read(client) ? EPOLLIN : 0;
+    if (result == 0)
+        epoll_set_events(client, in);
+    else
+        epoll_set_events(client, (client->flags & CLIENT_CLOSE_AFTER_REPLY) ? EPOLLOUT : in | EPOLLOUT);
+}
+
+// Read everything the socket has, executing commands as they complete,
+// until the client has too much output waiting
+static void epoll_read(Client *client)
+{
+    while (client_can_read(client))
+    {
+        ssize_t n = recv(client->fd, read_buffer, sizeof(read_buffer), 0);
+        if (n > 0)
+        {
+            if (client_feed(client, read_buffer, n) == -1)
+                break;
+            continue;
+        }
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n == 0)
+        {
+            // Peer finished sending; answer what it sent, then close
+            client->flags |= CLIENT_CLOSE_AFTER_REPLY;
+            break;
+        }
+
+        log_info("Receive failed: %s", strerror(errno));
+        epoll_close(client);
+        return;
+    }
+    epoll_flush(client);
+}
+
+// Watch a client's socket, for writability too when output is queued
+static int epoll_attach(Client *client)
+{
+    EpollConn *conn = (EpollConn *)calloc(1, sizeof(EpollConn));
+    if (conn == NULL)
+    {
+        log_error("Failed to allocate client");
+        return -1;
+    }
+    conn->client = client;
+    conn->events = client_has_output(client) ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    client->backend = conn;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = conn->events;
+    ev.data.ptr = client;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client->fd, &ev) == -1)
+    {
+        log_error("epoll_ctl failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Accept every pending connection
+static void epoll_accept(void)
+{
+    while (1)
+    {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                log_error("Client accept failed: %s", strerror(errno));
+            if (errno != EINTR)
+                return;
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        Client *client = client_create(fd);
+        if (client == NULL)
+        {
+            log_error("Failed to allocate client");
+            close(fd);
+            continue;
+        }
+        if (epoll_attach(client) == -1)
+        {
+            close(fd);
+            client_free(client);
+        }
+    }
+}
+
+static void epoll_client_event(Client *client, uint32_t events)
+{
+    if (client->flags & CLIENT_CLOSED)
+        return;
+
+    // Zerocopy completions are reported as EPOLLERR
+    if (events & EPOLLERR)
+        reply_zerocopy_reap(client->fd, &client->out);
+
+    if (client->flags & CLIENT_CLOSING)
+    {
+        epoll_close(client);
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+    {
+        epoll_read(client);
+        return;
+    }
+    if (events & EPOLLOUT)
+        epoll_flush(client);
+}
+
+static void epoll_run(void)
+{
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    time_t last_cron = 0;
+
+    while (1)
+    {
+        int n = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, 1000);
+        if (n == -1)
+        {
+            if (errno != EINTR)
+                log_error("epoll_wait failed: %s", strerror(errno));
+            continue;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == NULL)
+                epoll_accept();
+            else
+                epoll_client_event((Client *)events[i].data.ptr, events[i].events);
+        }
+        if (lingering)
+            epoll_expire();
+        if (time(NULL) != last_cron)
+        {
+            last_cron = time(NULL);
+            server_cron();
+        }
+        epoll_free_closed();
+    }
+}
+
+// Output was queued for a client outside its own read path
+static void epoll_wake(Client *client)
+{
+    if (!(client->flags & (CLIENT_CLOSING | CLIENT_CLOSED)))
+        epoll_flush(client);
+}
+
+// Close a client outside its own read path
+static void epoll_kill(Client *client)
+{
+    if (!(client->flags & (CLIENT_CLOSING | CLIENT_CLOSED)))
+        epoll_close(client);
+}
+
+const NetBackend net_epoll = {"epoll", epoll_init, epoll_run, epoll_wake, epoll_kill, epoll_attach};
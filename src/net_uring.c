@@ -0,0 +1,651 @@
+// net_uring.c - io_uring networking backend for the Mini-Redis project
+// This file serves client connections through io_uring: one multishot accept,
+// a multishot receive per client drawing from a provided-buffer ring, and
+// batched sends, so a single io_uring_enter covers many clients.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/io_uring.h>
+#include "net.h"
+#include "server.h"
+#include "config.h"
+#include "log.h"
+
+#if defined(IORING_CQE_F_NOTIF) && defined(__NR_io_uring_setup)
+
+#define URING_ENTRIES 1024
+#define URING_BUF_COUNT 256 // Power of two
+#define URING_BUF_SIZE (16 * 1024)
+#define URING_BUF_GROUP 0
+#define URING_SEND_IOV 64
+
+// Operation tags kept in the low bits of user_data next to the Client pointer
+#define URING_OP_ACCEPT 0
+#define URING_OP_RECV 1
+#define URING_OP_SEND 2
+#define URING_OP_CANCEL 3
+#define URING_OP_TIMER 4
+#define URING_OP_MASK 7
+
+// Per-connection io_uring state
+typedef struct
+{
+    int inflight;     // Receive and send requests the kernel still owns
+    int recv_armed;   // A receive will produce more completions
+    int recv_cancelled; // The armed receive was cancelled to stop reading
+    int send_busy;    // A send is in flight
+    int send_zerocopy; // The send in flight is IORING_OP_SENDMSG_ZC
+    uint32_t zc_notified;
+    struct msghdr msg;
+    struct iovec iov[URING_SEND_IOV];
+} UringConn;
+
+// Submission and completion rings shared with the kernel
+static struct
+{
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    struct io_uring_sqe *sqes;
+    unsigned sqe_tail; // Includes entries not yet published to the kernel
+    char *sq_map;      // Mappings, kept to unmap them if setup fails
+    size_t sq_map_len;
+    char *cq_map;      // Separate from sq_map without IORING_FEAT_SINGLE_MMAP
+    size_t cq_map_len;
+    size_t sqes_len;
+} ring = {.fd = -1};
+
+static int listen_fd = -1;
+static struct io_uring_buf_ring *buf_ring = NULL;
+static char *buf_base = NULL;
+static unsigned short buf_tail = 0;
+static int multishot_accept = 1;
+static int multishot_recv = 1;
+static int have_send_zc = 0;
+static struct __kernel_timespec cron_interval = {1, 0};
+
+static int uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, ring.fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+// Publish queued entries and hand them to the kernel, optionally waiting
+static int uring_submit(unsigned wait_nr)
+{
+    __atomic_store_n(ring.sq_tail, ring.sqe_tail, __ATOMIC_RELEASE);
+    unsigned pending = ring.sqe_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+
+    int ret = uring_enter(pending, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    if (ret == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        log_error("io_uring_enter failed: %s", strerror(errno));
+    return ret;
+}
+
+static struct io_uring_sqe *uring_get_sqe(void)
+{
+    if (ring.sqe_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries)
+    {
+        uring_submit(0);
+        if (ring.sqe_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries)
+        {
+            log_error("io_uring submission queue full");
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &ring.sqes[ring.sqe_tail & ring.sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring.sqe_tail++;
+    return sqe;
+}
+
+// Return a receive buffer to the kernel
+static void uring_recycle_buffer(unsigned short bid)
+{
+    struct io_uring_buf *buf = &buf_ring->bufs[buf_tail & (URING_BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(buf_base + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    buf_tail++;
+    __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+}
+
+static int uring_setup_buffers(void)
+{
+    size_t ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    buf_ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (buf_ring == MAP_FAILED)
+    {
+        buf_ring = NULL;
+        return -1;
+    }
+    buf_base = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (buf_base == NULL)
+        return -1;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    {
+        log_error("Provided buffer rings unsupported: %s", strerror(errno));
+        return -1;
+    }
+
+    for (unsigned short bid = 0; bid < URING_BUF_COUNT; bid++)
+        uring_recycle_buffer(bid);
+    return 0;
+}
+
+// Check whether the kernel implements zerocopy sends
+static void uring_probe(void)
+{
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    if (probe == NULL)
+        return;
+    if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+        probe->last_op >= IORING_OP_SENDMSG_ZC)
+    {
+        have_send_zc = (probe->ops[IORING_OP_SENDMSG_ZC].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+    free(probe);
+}
+
+static int uring_map_rings(struct io_uring_params *p)
+{
+    size_t sq_len = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    size_t cq_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p->features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+    if (single && cq_len > sq_len)
+        sq_len = cq_len;
+
+    char *sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED)
+        return -1;
+    ring.sq_map = sq;
+    ring.sq_map_len = sq_len;
+    char *cq = sq;
+    if (!single)
+    {
+        cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED)
+            return -1;
+        ring.cq_map = cq;
+        ring.cq_map_len = cq_len;
+    }
+    size_t sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqes = mmap(NULL, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED)
+    {
+        ring.sqes = NULL;
+        return -1;
+    }
+    ring.sqes_len = sqes_len;
+
+    ring.sq_head = (unsigned *)(sq + p->sq_off.head);
+    ring.sq_tail = (unsigned *)(sq + p->sq_off.tail);
+    ring.sq_mask = *(unsigned *)(sq + p->sq_off.ring_mask);
+    ring.sq_entries = p->sq_entries;
+    ring.cq_head = (unsigned *)(cq + p->cq_off.head);
+    ring.cq_tail = (unsigned *)(cq + p->cq_off.tail);
+    ring.cq_mask = *(unsigned *)(cq + p->cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+
+    // Submission slots map one-to-one onto the SQE array
+    unsigned *array = (unsigned *)(sq + p->sq_off.array);
+    for (unsigned i = 0; i < p->sq_entries; i++)
+        array[i] = i;
+    ring.sqe_tail = *ring.sq_tail;
+    return 0;
+}
+
+// Undo a partial setup: unmap the rings, free the buffer ring and close the
+// ring, so the server can fall back to epoll without leaking them
+static void uring_teardown(void)
+{
+    if (ring.sqes)
+        munmap(ring.sqes, ring.sqes_len);
+    if (ring.cq_map)
+        munmap(ring.cq_map, ring.cq_map_len);
+    if (ring.sq_map)
+        munmap(ring.sq_map, ring.sq_map_len);
+    if (buf_ring)
+        munmap(buf_ring, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+    free(buf_base);
+    close(ring.fd);
+    memset(&ring, 0, sizeof(ring));
+    ring.fd = -1;
+    buf_ring = NULL;
+    buf_base = NULL;
+    buf_tail = 0;
+}
+
+static void uring_arm_accept(void)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (sqe == NULL)
+        return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = multishot_accept ? IORING_ACCEPT_MULTISHOT : 0;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = URING_OP_ACCEPT;
+}
+
+// Complete once a second so server_cron() runs on an idle server too
+static void uring_arm_timer(void)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (sqe == NULL)
+        return;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uint64_t)(uintptr_t)&cron_interval;
+    sqe->len = 1;
+    sqe->user_data = URING_OP_TIMER;
+}
+
+static void uring_arm_recv(Client *client)
+{
+    UringConn *conn = (UringConn *)client->backend;
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (sqe == NULL)
+        return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client->fd;
+    sqe->ioprio = multishot_recv ? IORING_RECV_MULTISHOT : 0;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = (uint64_t)(uintptr_t)client | URING_OP_RECV;
+    conn->recv_armed = 1;
+    conn->recv_cancelled = 0;
+    conn->inflight++;
+}
+
+// Stop a multishot receive while the client has too much output unsent.
+// Completions already queued are still delivered and fed.
+static void uring_pause_recv(Client *client)
+{
+    UringConn *conn = (UringConn *)client->backend;
+    if (!conn->recv_armed || conn->recv_cancelled)
+        return;
+
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (sqe == NULL)
+        return;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = (uint64_t)(uintptr_t)client | URING_OP_RECV;
+    sqe->user_data = URING_OP_CANCEL;
+    conn->recv_cancelled = 1;
+}
+
+// Free a closed client once the kernel holds nothing of it
+static void uring_maybe_free(Client *client)
+{
+    UringConn *conn = (UringConn *)client->backend;
+    if (conn->inflight == 0 && !reply_zerocopy_pending(&client->out))
+        client_free(client);
+}
+
+// Close a client: cancel its requests, then close the socket when they return
+static void uring_close(Client *client)
+{
+    UringConn *conn = (UringConn *)client->backend;
+
+    if (!(client->flags & CLIENT_CLOSING))
+    {
+        client->flags |= CLIENT_CLOSING;
+        if (conn->inflight > 0)
+        {
+            struct io_uring_sqe *sqe = uring_get_sqe();
+            if (sqe)
+            {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = client->fd;
+                sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+                sqe->user_data = URING_OP_CANCEL;
+            }
+        }
+    }
+
+    // Zerocopy notifications arrive on the ring, not the socket, so the
+    // descriptor can go as soon as no request uses it
+    if (conn->inflight == 0 && !(client->flags & CLIENT_CLOSED))
+    {
+        close(client->fd);
+        client->flags |= CLIENT_CLOSED;
+    }
+    if (client->flags & CLIENT_CLOSED)
+        uring_maybe_free(client);
+}
+
+// Queue a send of pending output if none is in flight. It goes out with
+// the next io_uring_enter together with every other client's.
+static void uring_flush(Client *client)
+{
+    UringConn *conn = (UringConn *)client->backend;
+
+    if (conn->send_busy || (client->flags & CLIENT_CLOSING))
+        return;
+    if (!client_has_output(client) && !client_refill(client))
+    {
+        if (client->flags & CLIENT_CLOSE_AFTER_REPLY)
+            uring_close(client);
+        return;
+    }
+
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (sqe == NULL)
+        return;
+
+    memset(&conn->msg, 0, sizeof(conn->msg));
+    conn->msg.msg_iov = conn->iov;
+    conn->msg.msg_iovlen = reply_fill_iov(&client->out, conn->iov, URING_SEND_IOV);
+    conn->send_zerocopy = have_send_zc && reply_wants_zerocopy(&client->out);
+
+    sqe->opcode = conn->send_zerocopy ? IORING_OP_SENDMSG_ZC : IORING_OP_SENDMSG;
+    sqe->fd = client->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&conn->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uint64_t)(uintptr_t)client | URING_OP_SEND;
+    conn->send_busy = 1;
+    conn->inflight++;
+}
+
+// Start receiving on a client and send any output already queued
+static int uring_attach(Client *client)
+{
+    UringConn *conn = (UringConn *)calloc(1, sizeof(UringConn));
+    if (conn == NULL)
+    {
+        log_error("Failed to allocate client");
+        return -1;
+    }
+    client->backend = conn;
+    uring_arm_recv(client);
+    uring_flush(client);
+    return 0;
+}
+
+static void uring_handle_accept(struct io_uring_cqe *cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        if (cqe->res == -EINVAL && multishot_accept)
+        {
+            log_info("Multishot accept unsupported, using single-shot accepts");
+            multishot_accept = 0;
+        }
+        uring_arm_accept();
+    }
+    if (cqe->res < 0)
+    {
+        if (cqe->res != -EINVAL)
+            log_error("Client accept failed: %s", strerror(-cqe->res));
+        return;
+    }
+
+    int fd = cqe->res;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    Client *client = client_create(fd);
+    if (client == NULL)
+    {
+        log_error("Failed to allocate client");
+        close(fd);
+        return;
+    }
+    if (uring_attach(client) == -1)
+    {
+        client_free(client);
+        close(fd);
+    }
+}
+
+static void uring_handle_recv(Client *client, struct io_uring_cqe *cqe)
+{
+    UringConn *conn = (UringConn *)client->backend;
+    int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+    if (!more)
+    {
+        conn->recv_armed = 0;
+        conn->inflight--;
+    }
+
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (cqe->res > 0 && !(client->flags & CLIENT_CLOSING))
+            client_feed(client, buf_base + (size_t)bid * URING_BUF_SIZE, cqe->res);
+        uring_recycle_buffer(bid);
+    }
+
+    if (client->flags & CLIENT_CLOSING)
+    {
+        uring_close(client);
+        return;
+    }
+
+    if (cqe->res == 0)
+    {
+        // Peer finished sending; answer what it sent, then close
+        client->flags |= CLIENT_CLOSE_AFTER_REPLY;
+    }
+    else if (cqe->res == -ECANCELED && conn->recv_cancelled)
+    {
+        // Paused; uring_handle_send rearms once output drains
+        if (client_can_read(client) && !(client->flags & CLIENT_CLOSE_AFTER_REPLY))
+            uring_arm_recv(client);
+    }
+    else if (cqe->res < 0 && cqe->res != -ENOBUFS)
+    {
+        if (cqe->res == -EINVAL && multishot_recv)
+        {
+            log_info("Multishot receive unsupported, using single-shot receives");
+            multishot_recv = 0;
+            uring_arm_recv(client);
+            return;
+        }
+        log_info("Receive failed: %s", strerror(-cqe->res));
+        uring_close(client);
+        return;
+    }
+    else if (!client_can_read(client))
+    {
+        uring_pause_recv(client);
+    }
+    else if (!more && !(client->flags & CLIENT_CLOSE_AFTER_REPLY))
+    {
+        // Rearm after a single-shot receive or when buffers ran out
+        uring_arm_recv(client);
+    }
+    uring_flush(client);
+}
+
+static void uring_handle_send(Client *client, struct io_uring_cqe *cqe)
+{
+    UringConn *conn = (UringConn *)client->backend;
+
+    // A zerocopy send reports twice: the result, then a notification once
+    // the kernel no longer references the buffers
+    if (cqe->flags & IORING_CQE_F_NOTIF)
+    {
+        reply_zerocopy_complete(&client->out, ++conn->zc_notified);
+        if (client->flags & CLIENT_CLOSED)
+            uring_maybe_free(client);
+        return;
+    }
+
+    conn->send_busy = 0;
+    conn->inflight--;
+    if (conn->send_zerocopy)
+    {
+        client->out.zc_issued++;
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+            conn->zc_notified++; // No notification will follow
+    }
+
+    if (cqe->res > 0)
+        reply_consume(&client->out, cqe->res, conn->send_zerocopy);
+    if (conn->send_zerocopy)
+        reply_zerocopy_complete(&client->out, conn->zc_notified);
+
+    if (client->flags & CLIENT_CLOSING)
+    {
+        uring_close(client);
+        return;
+    }
+    if (cqe->res < 0)
+    {
+        log_error("Failed to send reply: %s", strerror(-cqe->res));
+        uring_close(client);
+        return;
+    }
+    // Resume reading a paused client once enough output has gone out
+    if (!conn->recv_armed && !(client->flags & CLIENT_CLOSE_AFTER_REPLY) && client_can_read(client))
+        uring_arm_recv(client);
+    uring_flush(client);
+}
+
+static void uring_handle_cqe(struct io_uring_cqe *cqe)
+{
+    unsigned op = cqe->user_data & URING_OP_MASK;
+    Client *client = (Client *)(uintptr_t)(cqe->user_data & ~(uint64_t)URING_OP_MASK);
+
+    switch (op)
+    {
+    case URING_OP_ACCEPT:
+        uring_handle_accept(cqe);
+        break;
+    case URING_OP_RECV:
+        uring_handle_recv(client, cqe);
+        break;
+    case URING_OP_SEND:
+        uring_handle_send(client, cqe);
+        break;
+    case URING_OP_TIMER:
+        uring_arm_timer();
+        server_cron();
+        break;
+    default:
+        break; // Cancellation results need no handling
+    }
+}
+
+static int uring_init(int server_socket)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = URING_ENTRIES * 4;
+    ring.fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring.fd == -1 && errno == EINVAL)
+    {
+        // Older kernels reject the optional flags
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = URING_ENTRIES * 4;
+        ring.fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    }
+    if (ring.fd == -1)
+    {
+        log_error("io_uring unavailable: %s", strerror(errno));
+        return -1;
+    }
+
+    if (!(params.features & IORING_FEAT_NODROP) || uring_map_rings(&params) == -1 || uring_setup_buffers() == -1)
+    {
+        log_error("io_uring lacks required features");
+        uring_teardown();
+        return -1;
+    }
+    uring_probe();
+
+    listen_fd = server_socket;
+    uring_arm_accept();
+    uring_arm_timer();
+    return 0;
+}
+
+static void uring_run(void)
+{
+    while (1)
+    {
+        // One enter submits every queued accept/recv/send and waits for work
+        uring_submit(1);
+
+        unsigned head = *ring.cq_head;
+        while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe cqe = ring.cqes[head & ring.cq_mask];
+            head++;
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+            uring_handle_cqe(&cqe);
+        }
+    }
+}
+
+static void uring_wake(Client *client)
+{
+    uring_flush(client);
+}
+
+static void uring_kill(Client *client)
+{
+    if (!(client->flags & CLIENT_CLOSING))
+        uring_close(client);
+}
+
+#else
+
+static int uring_init(int server_socket)
+{
+    (void)server_socket;
+    log_error("io_uring support was not compiled in");
+    return -1;
+}
+
+static void uring_run(void)
+{
+}
+
+static void uring_wake(Client *client)
+{
+    (void)client;
+}
+
+static void uring_kill(Client *client)
+{
+    (void)client;
+}
+
+static int uring_attach(Client *client)
+{
+    (void)client;
+    return -1;
+}
+
+#endif
+
+const NetBackend net_uring = {"io_uring", uring_init, uring_run, uring_wake, uring_kill, uring_attach};
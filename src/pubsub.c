@@ -0,0 +1,353 @@
+// pubsub.c - Publish/subscribe channels for the Mini-Redis project
+// This file keeps channel and pattern subscriptions and fans published
+// messages out to subscribers through shared, reference-counted buffers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <json-c/json.h>
+#include "pubsub.h"
+#include "net.h"
+#include "config.h"
+#include "log.h"
+
+// A channel, or a pattern, and the clients subscribed to it
+typedef struct PubsubTarget
+{
+    char *name;
+    Client **clients;
+    size_t count;
+    size_t capacity;
+    struct PubsubTarget *next; // Next in the hash bucket or pattern list
+} PubsubTarget;
+
+// One of a client's subscriptions, linked from Client.subscriptions
+typedef struct PubsubSubscription
+{
+    PubsubTarget *target;
+    int pattern;
+    struct PubsubSubscription *next;
+} PubsubSubscription;
+
+size_t pubsub_output_limit = PUBSUB_OUTPUT_LIMIT;
+
+static PubsubTarget *channels[PUBSUB_TABLE_SIZE];
+static PubsubTarget *patterns = NULL;
+static size_t channel_count = 0;
+static size_t pattern_count = 0;
+
+// Subscribers that received output during the current publish
+static Client **wake_list = NULL;
+static size_t wake_count = 0;
+static size_t wake_capacity = 0;
+
+static PubsubTarget **bucket_for(const char *name)
+{
+    unsigned int h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return &channels[h % PUBSUB_TABLE_SIZE];
+}
+
+// The list a channel or pattern lives in
+static PubsubTarget **list_for(const char *name, int pattern)
+{
+    return pattern ? &patterns : bucket_for(name);
+}
+
+static PubsubTarget *find_target(const char *name, int pattern)
+{
+    for (PubsubTarget *target = *list_for(name, pattern); target; target = target->next)
+    {
+        if (strcmp(target->name, name) == 0)
+            return target;
+    }
+    return NULL;
+}
+
+static PubsubTarget *create_target(const char *name, int pattern)
+{
+    PubsubTarget *target = (PubsubTarget *)calloc(1, sizeof(PubsubTarget));
+    if (target == NULL)
+        return NULL;
+    target->name = strdup(name);
+    if (target->name == NULL)
+    {
+        free(target);
+        return NULL;
+    }
+
+    PubsubTarget **list = list_for(name, pattern);
+    target->next = *list;
+    *list = target;
+    if (pattern)
+        pattern_count++;
+    else
+        channel_count++;
+    return target;
+}
+
+static void free_target(PubsubTarget *target, int pattern)
+{
+    PubsubTarget **link = list_for(target->name, pattern);
+    while (*link != target)
+        link = &(*link)->next;
+    *link = target->next;
+    if (pattern)
+        pattern_count--;
+    else
+        channel_count--;
+
+    free(target->clients);
+    free(target->name);
+    free(target);
+}
+
+static int target_add_client(PubsubTarget *target, Client *client)
+{
+    if (target->count == target->capacity)
+    {
+        size_t capacity = target->capacity ? target->capacity * 2 : 4;
+        Client **clients = (Client **)realloc(target->clients, capacity * sizeof(Client *));
+        if (clients == NULL)
+            return -1;
+        target->clients = clients;
+        target->capacity = capacity;
+    }
+    target->clients[target->count++] = client;
+    return 0;
+}
+
+static void target_remove_client(PubsubTarget *target, Client *client)
+{
+    for (size_t i = 0; i < target->count; i++)
+    {
+        if (target->clients[i] == client)
+        {
+            target->clients[i] = target->clients[--target->count];
+            return;
+        }
+    }
+}
+
+// Queue a JSON line confirming a subscription change
+static void reply_confirmation(Client *client, const char *type, const char *name, int pattern)
+{
+    json_object *reply = json_object_new_object();
+    json_object_object_add(reply, "type", json_object_new_string(type));
+    json_object_object_add(reply, pattern ? "pattern" : "channel", name ? json_object_new_string(name) : NULL);
+    json_object_object_add(reply, "count", json_object_new_uint64(client->subscription_count));
+
+    size_t len;
+    const char *text = json_object_to_json_string_length(reply, JSON_C_TO_STRING_PLAIN, &len);
+    reply_add(&client->out, text, len);
+    reply_add(&client->out, "\n", 1);
+    json_object_put(reply);
+}
+
+// Subscribe a client to a channel or pattern
+void pubsub_subscribe(Client *client, const char *name, int pattern)
+{
+    const char *type = pattern ? "psubscribe" : "subscribe";
+    PubsubTarget *target = find_target(name, pattern);
+
+    if (target)
+    {
+        for (PubsubSubscription *sub = client->subscriptions; sub; sub = sub->next)
+        {
+            if (sub->target == target)
+            {
+                reply_confirmation(client, type, name, pattern); // Already subscribed
+                return;
+            }
+        }
+    }
+    else
+    {
+        target = create_target(name, pattern);
+    }
+
+    PubsubSubscription *sub = (PubsubSubscription *)malloc(sizeof(PubsubSubscription));
+    if (target == NULL || sub == NULL || target_add_client(target, client) == -1)
+    {
+        log_error("Failed to subscribe to %s", name);
+        free(sub);
+        if (target && target->count == 0)
+            free_target(target, pattern);
+        reply_add(&client->out, "ERROR\n", 6);
+        return;
+    }
+    sub->target = target;
+    sub->pattern = pattern;
+    sub->next = client->subscriptions;
+    client->subscriptions = sub;
+    client->subscription_count++;
+
+    reply_confirmation(client, type, name, pattern);
+}
+
+// Remove one subscription from a client's list and from its target
+static void remove_subscription(Client *client, PubsubSubscription **link)
+{
+    PubsubSubscription *sub = *link;
+    *link = sub->next;
+    client->subscription_count--;
+
+    target_remove_client(sub->target, client);
+    if (sub->target->count == 0)
+        free_target(sub->target, sub->pattern);
+    free(sub);
+}
+
+// Unsubscribe a client from one or all channels or patterns
+void pubsub_unsubscribe(Client *client, const char *name, int pattern)
+{
+    const char *type = pattern ? "punsubscribe" : "unsubscribe";
+    PubsubSubscription **link = &client->subscriptions;
+    int removed = 0;
+
+    while (*link)
+    {
+        PubsubSubscription *sub = *link;
+        if (sub->pattern != pattern || (name && strcmp(sub->target->name, name) != 0))
+        {
+            link = &sub->next;
+            continue;
+        }
+
+        // The name is freed with the last subscriber, so confirm with a copy
+        char *target_name = strdup(sub->target->name);
+        remove_subscription(client, link);
+        reply_confirmation(client, type, target_name ? target_name : name, pattern);
+        free(target_name);
+        removed = 1;
+    }
+
+    if (!removed)
+        reply_confirmation(client, type, name, pattern);
+}
+
+// Drop every subscription of a client that is going away
+void pubsub_client_free(Client *client)
+{
+    while (client->subscriptions)
+        remove_subscription(client, &client->subscriptions);
+}
+
+// Encode a delivery once as a JSON line
+static ReplyShared *encode_message(const char *pattern, const char *channel, const char *text)
+{
+    json_object *obj = json_object_new_object();
+    json_object_object_add(obj, "type", json_object_new_string(pattern ? "pmessage" : "message"));
+    if (pattern)
+        json_object_object_add(obj, "pattern", json_object_new_string(pattern));
+    json_object_object_add(obj, "channel", json_object_new_string(channel));
+    json_object_object_add(obj, "message", json_object_new_string(text));
+
+    size_t len;
+    const char *json = json_object_to_json_string_length(obj, JSON_C_TO_STRING_PLAIN, &len);
+    ReplyShared *message = reply_shared_new(len + 1); // Held by the publisher until fan-out is done
+    if (message)
+    {
+        memcpy(message->data, json, len);
+        message->data[len] = '\n';
+    }
+    json_object_put(obj);
+    return message;
+}
+
+// Queue a shared message on every live subscriber of a target
+static size_t deliver(PubsubTarget *target, int pattern, const char *channel, const char *text)
+{
+    ReplyShared *message = NULL;
+    size_t delivered = 0;
+
+    for (size_t i = 0; i < target->count; i++)
+    {
+        Client *client = target->clients[i];
+        if (client->flags & (CLIENT_CLOSE_AFTER_REPLY | CLIENT_CLOSING | CLIENT_CLOSED))
+            continue;
+
+        if (message == NULL)
+        {
+            message = encode_message(pattern ? target->name : NULL, channel, text);
+            if (message == NULL)
+            {
+                log_error("Failed to encode message for %s", channel);
+                return delivered;
+            }
+        }
+
+        reply_add_shared(&client->out, message);
+        delivered++;
+        if (client->flags & CLIENT_PUBSUB_QUEUED)
+            continue;
+
+        if (wake_count == wake_capacity)
+        {
+            size_t capacity = wake_capacity ? wake_capacity * 2 : 64;
+            Client **list = (Client **)realloc(wake_list, capacity * sizeof(Client *));
+            if (list == NULL)
+            {
+                // With no room to defer the wake, flush this subscriber now.
+                // Waking never frees a client, so the fan-out can go on.
+                log_error("Failed to allocate wake list, flushing subscriber directly");
+                net_backend->wake(client);
+                continue;
+            }
+            wake_list = list;
+            wake_capacity = capacity;
+        }
+        wake_list[wake_count++] = client;
+        client->flags |= CLIENT_PUBSUB_QUEUED;
+    }
+
+    if (message)
+        reply_shared_release(message);
+    return delivered;
+}
+
+// Deliver a message to every subscriber of a channel
+size_t pubsub_publish(Client *publisher, const char *channel, const char *message)
+{
+    size_t delivered = 0;
+
+    PubsubTarget *target = find_target(channel, 0);
+    if (target)
+        delivered += deliver(target, 0, channel, message);
+    for (target = patterns; target; target = target->next)
+    {
+        if (fnmatch(target->name, channel, 0) == 0)
+            delivered += deliver(target, 1, channel, message);
+    }
+
+    // Every subscriber is visited once, after all queueing is done, since
+    // closing one may free it. The publisher flushes on its own read path.
+    for (size_t i = 0; i < wake_count; i++)
+    {
+        Client *client = wake_list[i];
+        client->flags &= ~CLIENT_PUBSUB_QUEUED;
+        if (client == publisher)
+            continue;
+
+        if (pubsub_output_limit && client->out.bytes > pubsub_output_limit)
+        {
+            log_info("Subscriber output exceeds %zu bytes, disconnecting", pubsub_output_limit);
+            net_backend->close(client);
+        }
+        else
+        {
+            net_backend->wake(client);
+        }
+    }
+    wake_count = 0;
+    return delivered;
+}
+
+// Number of channels and patterns with at least one subscriber
+void pubsub_counts(size_t *channels_out, size_t *patterns_out)
+{
+    *channels_out = channel_count;
+    *patterns_out = pattern_count;
+}
@@ -0,0 +1,676 @@
+// repl.c - Primary-replica replication for the Mini-Redis project
+// This file streams every write to connected replicas, keeps a backlog of
+// the stream for partial resyncs, and on a replica follows a primary:
+// connecting, loading its snapshot and applying its stream.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "repl.h"
+#include "database.h"
+#include "multi.h"
+#include "circular_buffer.h"
+#include "net.h"
+#include "config.h"
+#include "log.h"
+
+#define SNAPSHOT_SCAN_BATCH 64 // Keys visited per tree walk while filling a snapshot chunk
+
+// A full snapshot being sent to a replica. Keys go out in order, a chunk at
+// a time as the replica reads them, so neither the snapshot nor the work of
+// decoding it lands on the event loop all at once. Writes made meanwhile are
+// held back until after the last key. The replica may get a key's newer
+// value in the snapshot and then replay older writes to it, but every write
+// replaces or deletes whole keys, so the final state matches the primary's.
+typedef struct ReplSnapshot
+{
+    char *cursor;     // Last key sent, NULL before the first
+    const char *last; // Last key visited by the current walk
+    size_t keys;      // Keys sent so far
+    int failed;       // A value could not be decoded or the cursor saved
+    ReplyQueue held;  // Stream written since the snapshot began
+} ReplSnapshot;
+
+// Replication history shared by a primary and the replicas that follow it.
+// A replica adopts its primary's ID and offset on a full resync.
+static char replid[REPL_ID_SIZE + 1];
+static unsigned long long repl_offset = 0;
+
+// Stream bytes (repl_offset - backlog.count, repl_offset], allocated when
+// the first replica connects
+static CircularBuffer backlog;
+
+static Client **replicas = NULL;
+static size_t replica_count = 0;
+static size_t replica_capacity = 0;
+static Client **wake_list = NULL;
+static unsigned long long full_syncs = 0;
+static unsigned long long partial_syncs = 0;
+
+// Replica side
+static int replica_role = 0;
+static char master_host[256];
+static int master_port = 0;
+static Client *master_link = NULL;
+static int master_synced = 0;
+static int snapshot_loading = 0;                // Applying a snapshot until its end marker
+static unsigned long long snapshot_loaded = 0;  // Keys applied from that snapshot
+static time_t next_attempt = 0;
+
+// Pick a new replication ID, starting a new history
+static void new_replid(void)
+{
+    unsigned char bytes[REPL_ID_SIZE / 2];
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || read(fd, bytes, sizeof(bytes)) != (ssize_t)sizeof(bytes))
+    {
+        srand((unsigned)time(NULL) ^ (unsigned)getpid());
+        for (size_t i = 0; i < sizeof(bytes); i++)
+            bytes[i] = (unsigned char)rand();
+    }
+    if (fd != -1)
+        close(fd);
+
+    for (size_t i = 0; i < sizeof(bytes); i++)
+        snprintf(replid + i * 2, 3, "%02x", bytes[i]);
+}
+
+// Pick a fresh replication ID
+void repl_init(void)
+{
+    new_replid();
+    repl_offset = 0;
+}
+
+// Build a write as sent on the replication stream
+static json_object *command_object(const char *operation, const char *key, json_object *value)
+{
+    json_object *command = json_object_new_object();
+    if (key)
+        json_object_object_add(command, "key", json_object_new_string(key));
+    json_object_object_add(command, "operation", json_object_new_string(operation));
+    if (value)
+        json_object_object_add(command, "value", json_object_get(value));
+    return command;
+}
+
+// Queue a JSON object on a client's output without a separator, so stream
+// offsets count exactly the bytes of each message
+static void reply_add_object(Client *client, json_object *obj)
+{
+    size_t len;
+    const char *text = json_object_to_json_string_length(obj, JSON_C_TO_STRING_PLAIN, &len);
+    reply_add(&client->out, text, len);
+}
+
+static int add_replica(Client *client)
+{
+    if (replica_count == replica_capacity)
+    {
+        size_t capacity = replica_capacity ? replica_capacity * 2 : 4;
+        Client **list = (Client **)realloc(replicas, capacity * sizeof(Client *));
+        Client **wake = (Client **)realloc(wake_list, capacity * sizeof(Client *));
+        if (wake)
+            wake_list = wake;
+        if (list == NULL || wake == NULL)
+        {
+            if (list)
+                replicas = list;
+            return -1;
+        }
+        replicas = list;
+        replica_capacity = capacity;
+    }
+    replicas[replica_count++] = client;
+    client->flags |= CLIENT_REPLICA;
+    return 0;
+}
+
+// Close every replica; used when this node's history is replaced
+static void drop_replicas(void)
+{
+    size_t count = replica_count;
+    if (count == 0)
+        return;
+    memcpy(wake_list, replicas, count * sizeof(Client *));
+    for (size_t i = 0; i < count; i++)
+        net_backend->close(wake_list[i]);
+}
+
+// Append stream bytes to the backlog and queue them for every replica
+static void feed(const char *data, size_t len)
+{
+    buffer_write_len(&backlog, data, len);
+    if (replica_count == 0)
+        return;
+
+    ReplyShared *shared = reply_shared_new(len);
+    if (shared == NULL)
+    {
+        // The replicas would miss this write, so make them resync
+        log_error("Failed to allocate replication buffer");
+        drop_replicas();
+        return;
+    }
+    memcpy(shared->data, data, len);
+
+    size_t count = 0;
+    for (size_t i = 0; i < replica_count; i++)
+    {
+        Client *client = replicas[i];
+        if (client->flags & (CLIENT_CLOSING | CLIENT_CLOSED))
+            continue;
+        reply_add_shared(client->snapshot ? &client->snapshot->held : &client->out, shared);
+        wake_list[count++] = client;
+    }
+    reply_shared_release(shared);
+
+    // Waking or closing a replica may free it, which edits `replicas`. While
+    // a snapshot is sent only the held writes count against the limit.
+    for (size_t i = 0; i < count; i++)
+    {
+        Client *client = wake_list[i];
+        size_t behind = client->snapshot ? client->snapshot->held.bytes : client->out.bytes;
+        if (behind > REPL_OUTPUT_LIMIT)
+        {
+            log_error("Replica fell more than %d bytes behind, disconnecting", REPL_OUTPUT_LIMIT);
+            net_backend->close(client);
+        }
+        else
+        {
+            net_backend->wake(client);
+        }
+    }
+}
+
+// Advance the stream by one write
+static void propagate(json_object *command)
+{
+    size_t len;
+    const char *text = json_object_to_json_string_length(command, JSON_C_TO_STRING_PLAIN, &len);
+    repl_offset += len;
+    feed(text, len);
+}
+
+// Send a SET to the backlog and every replica
+void repl_propagate_set(const char *key, json_object *value)
+{
+    // Nothing can resume from a history no replica has seen
+    if (backlog.buffer == NULL)
+        return;
+    json_object *command = command_object("SET", key, value);
+    propagate(command);
+    json_object_put(command);
+}
+
+// Send a DEL or UNLINK to the backlog and every replica
+void repl_propagate_del(const char *key, int lazy)
+{
+    if (backlog.buffer == NULL)
+        return;
+    json_object *command = command_object(lazy ? "UNLINK" : "DEL", key, NULL);
+    propagate(command);
+    json_object_put(command);
+}
+
+// Send a FLUSHALL to the backlog and every replica
+void repl_propagate_flushall(void)
+{
+    if (backlog.buffer == NULL)
+        return;
+    json_object *command = command_object("FLUSHALL", NULL, NULL);
+    propagate(command);
+    json_object_put(command);
+}
+
+// Queue one key of a full snapshot as a SET. Values go out decoded, since
+// the replica decides for itself what to compress.
+static void snapshot_key(const KeyValue *node, void *ctx)
+{
+    Client *client = (Client *)ctx;
+    ReplSnapshot *snapshot = client->snapshot;
+    if (snapshot->failed)
+        return;
+
+    snapshot->last = node->key;
+    json_object *value = db_decode_value(node);
+    if (value == NULL)
+    {
+        log_error("Failed to decode the value of %s for a replica", node->key);
+        snapshot->failed = 1;
+        return;
+    }
+    json_object *command = command_object("SET", node->key, value);
+    reply_add_object(client, command);
+    json_object_put(command);
+    json_object_put(value);
+    snapshot->keys++;
+}
+
+static void snapshot_free(Client *client)
+{
+    ReplSnapshot *snapshot = client->snapshot;
+    free(snapshot->cursor);
+    reply_queue_free(&snapshot->held);
+    free(snapshot);
+    client->snapshot = NULL;
+}
+
+// Queue the next chunk of a replica's snapshot, then after the last key an
+// end marker and the writes held back meanwhile
+int repl_refill(Client *client)
+{
+    ReplSnapshot *snapshot = client->snapshot;
+    if (snapshot == NULL || (client->flags & CLIENT_CLOSE_AFTER_REPLY))
+        return 0;
+
+    int more = 1;
+    while (more && !snapshot->failed && client->out.bytes < REPL_SNAPSHOT_CHUNK)
+    {
+        snapshot->last = NULL;
+        more = db_scan(snapshot->cursor, SNAPSHOT_SCAN_BATCH, snapshot_key, client);
+        if (snapshot->last)
+        {
+            char *cursor = strdup(snapshot->last);
+            if (cursor == NULL)
+            {
+                snapshot->failed = 1;
+                break;
+            }
+            free(snapshot->cursor);
+            snapshot->cursor = cursor;
+        }
+    }
+
+    if (snapshot->failed)
+    {
+        // The replica sees a broken stream, drops the link and resyncs
+        snapshot_free(client);
+        client_fail(client, "ERROR: Snapshot failed\n");
+        return 1;
+    }
+    if (!more)
+    {
+        static const char end[] = "{\"type\":\"snapshot_end\"}";
+        reply_add(&client->out, end, sizeof(end) - 1);
+        reply_queue_append(&client->out, &snapshot->held);
+        log_info("Replica sent a full snapshot of %zu keys", snapshot->keys);
+        snapshot_free(client);
+    }
+    return 1;
+}
+
+// Handle PSYNC from a replica
+void repl_psync(Client *client, const char *id, const char *offset_str)
+{
+    if (replica_role && !master_synced)
+    {
+        reply_add(&client->out, "ERROR: Replica not synced\n", 26);
+        return;
+    }
+    if (client->flags & CLIENT_REPLICA)
+    {
+        reply_add(&client->out, "ERROR: Already a replica\n", 25);
+        return;
+    }
+    if (backlog.buffer == NULL)
+    {
+        buffer_init(&backlog, REPL_BACKLOG_SIZE);
+        if (backlog.buffer == NULL)
+        {
+            reply_add(&client->out, "ERROR\n", 6);
+            return;
+        }
+    }
+    if (add_replica(client) == -1)
+    {
+        reply_add(&client->out, "ERROR\n", 6);
+        return;
+    }
+
+    json_object *header = json_object_new_object();
+    unsigned long long start = repl_offset - backlog.count;
+    char *end = NULL;
+    unsigned long long offset = offset_str ? strtoull(offset_str, &end, 10) : 0;
+
+    if (strcmp(id, replid) == 0 && end && *end == '\0' && offset >= start && offset <= repl_offset)
+    {
+        // Resume: send what the replica missed from the backlog
+        json_object_object_add(header, "type", json_object_new_string("continue"));
+        json_object_object_add(header, "replid", json_object_new_string(replid));
+        json_object_object_add(header, "offset", json_object_new_uint64(offset));
+        reply_add_object(client, header);
+
+        size_t missed = repl_offset - offset;
+        ReplyShared *shared = missed ? reply_shared_new(missed) : NULL;
+        if (shared)
+        {
+            buffer_peek(&backlog, offset - start, shared->data, missed);
+            reply_add_shared(&client->out, shared);
+            reply_shared_release(shared);
+        }
+        partial_syncs++;
+        log_info("Replica resumed at offset %llu", offset);
+    }
+    else
+    {
+        // Full resync: the snapshot is a run of SETs ending in a marker, then
+        // the stream follows from the header's offset. The keys are queued
+        // by repl_refill() as the replica's output drains.
+        ReplSnapshot *snapshot = (ReplSnapshot *)calloc(1, sizeof(ReplSnapshot));
+        if (snapshot == NULL)
+        {
+            client_fail(client, "ERROR\n");
+            json_object_put(header);
+            return;
+        }
+        reply_queue_init(&snapshot->held);
+        client->snapshot = snapshot;
+
+        json_object_object_add(header, "type", json_object_new_string("fullresync"));
+        json_object_object_add(header, "replid", json_object_new_string(replid));
+        json_object_object_add(header, "offset", json_object_new_uint64(repl_offset));
+        reply_add_object(client, header);
+        full_syncs++;
+        log_info("Sending a full snapshot to a replica");
+    }
+    json_object_put(header);
+}
+
+// Forget the link to the primary. A snapshot cut short leaves a partial
+// keyspace that the ID and offset adopted from its header do not describe,
+// so start a new history; the next PSYNC then gets a full resync.
+static void master_link_lost(void)
+{
+    master_link = NULL;
+    if (snapshot_loading)
+    {
+        log_info("Snapshot from primary incomplete after %llu keys", snapshot_loaded);
+        new_replid();
+        repl_offset = 0;
+        snapshot_loading = 0;
+    }
+    master_synced = 0;
+}
+
+// Close the link to the primary, if any
+static void drop_master_link(void)
+{
+    Client *link = master_link;
+    master_link_lost();
+    if (link && net_backend)
+        net_backend->close(link);
+}
+
+// Follow a primary, or stop following one
+int repl_replicaof(const char *host, int port)
+{
+    if (host == NULL)
+    {
+        // Promoted: later writes start a history of our own
+        if (replica_role)
+        {
+            drop_master_link();
+            replica_role = 0;
+            drop_replicas();
+            new_replid();
+            log_info("Replication stopped, serving writes");
+        }
+        return 0;
+    }
+
+    if (strlen(host) >= sizeof(master_host))
+        return -1;
+    drop_master_link();
+    strcpy(master_host, host);
+    master_port = port;
+    replica_role = 1;
+    next_attempt = 0;
+    log_info("Replicating from %s:%d", master_host, master_port);
+    return 0;
+}
+
+// Whether this node follows a primary
+int repl_is_replica(void)
+{
+    return replica_role;
+}
+
+// Open a non-blocking connection to the primary and queue PSYNC on it
+static void repl_connect(void)
+{
+    char port[16];
+    struct addrinfo hints, *res;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%d", master_port);
+    if (getaddrinfo(master_host, port, &hints, &res) != 0)
+    {
+        log_error("Cannot resolve primary %s", master_host);
+        return;
+    }
+
+    int fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1 || (connect(fd, res->ai_addr, res->ai_addrlen) == -1 && errno != EINPROGRESS))
+    {
+        log_info("Cannot connect to primary %s:%d: %s", master_host, master_port, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        freeaddrinfo(res);
+        return;
+    }
+    freeaddrinfo(res);
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    Client *client = client_create(fd);
+    if (client == NULL)
+    {
+        close(fd);
+        return;
+    }
+    client->flags |= CLIENT_MASTER;
+
+    // Ask to resume our history; a primary that does not share it sends a snapshot
+    char offset[32];
+    snprintf(offset, sizeof(offset), "%llu", repl_offset);
+    json_object *psync = json_object_new_object();
+    json_object_object_add(psync, "key", json_object_new_string(replid));
+    json_object_object_add(psync, "operation", json_object_new_string("PSYNC"));
+    json_object_object_add(psync, "value", json_object_new_string(offset));
+    reply_add_object(client, psync);
+    json_object_put(psync);
+
+    if (net_backend->attach(client) == -1)
+    {
+        close(fd);
+        client_free(client);
+        return;
+    }
+    master_link = client;
+}
+
+// Connect to the primary when the link is down
+void repl_cron(void)
+{
+    time_t now = time(NULL);
+    if (!replica_role || master_link || now < next_attempt)
+        return;
+    next_attempt = now + REPL_RETRY_INTERVAL;
+    repl_connect();
+}
+
+// Handle a fullresync or continue header, or the end of a snapshot, from
+// the primary
+static void apply_header(Client *client, const char *type, json_object *command)
+{
+    if (strcmp(type, "snapshot_end") == 0)
+    {
+        if (!snapshot_loading)
+        {
+            client_fail(client, "ERROR: Bad replication header\n");
+            return;
+        }
+        snapshot_loading = 0;
+        master_synced = 1;
+        log_info("Loaded %llu keys from primary", snapshot_loaded);
+        return;
+    }
+
+    json_object *id_obj = NULL, *offset_obj = NULL;
+    json_object_object_get_ex(command, "replid", &id_obj);
+    json_object_object_get_ex(command, "offset", &offset_obj);
+    const char *id = json_object_get_string(id_obj);
+
+    if (id == NULL || strlen(id) != REPL_ID_SIZE)
+    {
+        client_fail(client, "ERROR: Bad replication header\n");
+        return;
+    }
+
+    if (strcmp(type, "fullresync") == 0)
+    {
+        // Our history is replaced, so replicas following it must start over
+        drop_replicas();
+        if (backlog.buffer)
+            backlog.head = backlog.tail = backlog.count = 0;
+        strcpy(replid, id);
+        repl_offset = json_object_get_int64(offset_obj);
+        db_flush(1);
+        multi_touch_all();
+        snapshot_loading = 1;
+        snapshot_loaded = 0;
+        log_info("Full resync from primary at offset %llu", repl_offset);
+    }
+    else if (strcmp(type, "continue") == 0)
+    {
+        if (strcmp(id, replid) != 0 || (unsigned long long)json_object_get_int64(offset_obj) != repl_offset)
+        {
+            client_fail(client, "ERROR: Bad replication offset\n");
+            return;
+        }
+        master_synced = 1;
+        log_info("Resumed replication at offset %llu", repl_offset);
+    }
+}
+
+// Apply one message from the primary's replication stream
+void repl_apply(Client *client, json_object *command)
+{
+    json_object *type_obj = NULL, *op_obj = NULL, *key_obj = NULL, *value_obj = NULL;
+
+    if (client != master_link)
+        return; // A link being replaced
+
+    if (json_object_object_get_ex(command, "type", &type_obj))
+    {
+        apply_header(client, json_object_get_string(type_obj), command);
+        return;
+    }
+
+    json_object_object_get_ex(command, "operation", &op_obj);
+    json_object_object_get_ex(command, "key", &key_obj);
+    json_object_object_get_ex(command, "value", &value_obj);
+    const char *op = json_object_get_string(op_obj);
+    const char *key = json_object_get_string(key_obj);
+    if (op == NULL || (key == NULL && strcmp(op, "FLUSHALL") != 0))
+        return;
+
+    // A replica always flushes in the background, so the stream keeps flowing
+    if (strcmp(op, "FLUSHALL") == 0)
+    {
+        db_flush(1);
+        multi_touch_all();
+    }
+    else if (strcmp(op, "SET") == 0 && value_obj)
+    {
+        db_set(key, json_object_get(value_obj));
+        multi_touch_key(key);
+    }
+    else if (strcmp(op, "DEL") == 0)
+    {
+        if (db_delete(key) == 0)
+            multi_touch_key(key);
+    }
+    else if (strcmp(op, "UNLINK") == 0)
+    {
+        if (db_unlink(key) == 0)
+            multi_touch_key(key);
+    }
+    else
+    {
+        return;
+    }
+
+    if (snapshot_loading)
+    {
+        snapshot_loaded++;
+        return;
+    }
+
+    // Pass the write on to our own replicas. The primary encodes writes the
+    // same way, so re-encoding keeps both offsets in step.
+    if (backlog.buffer)
+    {
+        json_object *copy = command_object(op, key, strcmp(op, "SET") == 0 ? value_obj : NULL);
+        propagate(copy);
+        json_object_put(copy);
+    }
+    else
+    {
+        repl_offset += client->command_bytes;
+    }
+}
+
+// Forget a replica or primary connection that is being freed
+void repl_client_free(Client *client)
+{
+    if (client == master_link)
+    {
+        master_link_lost();
+        log_info("Lost connection to primary %s:%d", master_host, master_port);
+    }
+    if (client->flags & CLIENT_REPLICA)
+    {
+        for (size_t i = 0; i < replica_count; i++)
+        {
+            if (replicas[i] == client)
+            {
+                replicas[i] = replicas[--replica_count];
+                break;
+            }
+        }
+    }
+    if (client->snapshot)
+        snapshot_free(client);
+}
+
+// Report replication state
+void repl_stats(ReplStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->replica = replica_role;
+    stats->replid = replid;
+    stats->offset = repl_offset;
+    stats->replicas = replica_count;
+    stats->backlog_bytes = backlog.buffer ? backlog.count : 0;
+    stats->full_syncs = full_syncs;
+    stats->partial_syncs = partial_syncs;
+    if (replica_role)
+    {
+        stats->master_host = master_host;
+        stats->master_port = master_port;
+        stats->master_link_up = master_link != NULL && master_synced;
+    }
+}
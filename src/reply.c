@@ -0,0 +1,471 @@
+// reply.c - Output queues for the Mini-Redis project
+// This file queues replies as segments that either coalesce small responses
+// into shared buffers or reference stored values directly, and writes them
+// with one gather write, using MSG_ZEROCOPY for large payloads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include "reply.h"
+#include "database.h"
+#include "lazyfree.h"
+#include "config.h"
+#include "log.h"
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+
+#define REPLY_FLUSH_IOV 64
+
+size_t zerocopy_threshold = ZEROCOPY_THRESHOLD;
+
+// Release callback for pinned values. The value may have been deleted since
+// and be queued for freeing on the lazyfree thread.
+static void release_value(void *owner)
+{
+    lazyfree_lock();
+    json_object_put((json_object *)owner);
+    lazyfree_unlock();
+}
+
+// Free a segment and whatever it holds
+static void segment_free(ReplySegment *segment)
+{
+    if (segment->release)
+        segment->release(segment->owner);
+    free(segment);
+}
+
+static void queue_append(ReplyQueue *queue, ReplySegment *segment)
+{
+    segment->next = NULL;
+    if (queue->tail)
+        queue->tail->next = segment;
+    else
+        queue->head = segment;
+    queue->tail = segment;
+    queue->bytes += segment->len;
+}
+
+// Initialize an empty queue
+void reply_queue_init(ReplyQueue *queue)
+{
+    memset(queue, 0, sizeof(ReplyQueue));
+}
+
+// Release every segment
+void reply_queue_free(ReplyQueue *queue)
+{
+    ReplySegment *lists[2] = {queue->head, queue->zc_head};
+    for (int i = 0; i < 2; i++)
+    {
+        ReplySegment *segment = lists[i];
+        while (segment)
+        {
+            ReplySegment *next = segment->next;
+            segment_free(segment);
+            segment = next;
+        }
+    }
+    reply_queue_init(queue);
+}
+
+// Move the segments of another queue to the end of this one
+void reply_queue_append(ReplyQueue *queue, ReplyQueue *from)
+{
+    if (from->head == NULL)
+        return;
+    if (queue->tail)
+        queue->tail->next = from->head;
+    else
+        queue->head = from->head;
+    queue->tail = from->tail;
+    queue->bytes += from->bytes;
+    reply_queue_init(from);
+}
+
+// Append a copy of bytes
+void reply_add(ReplyQueue *queue, const char *data, size_t len)
+{
+    ReplySegment *tail = queue->tail;
+
+    // Bytes after the written part of an owned buffer can still be filled in
+    if (tail && tail->capacity && tail->capacity - tail->len >= len)
+    {
+        memcpy(tail->data + tail->len, data, len);
+        tail->len += len;
+        queue->bytes += len;
+        return;
+    }
+
+    size_t capacity = len > REPLY_CHUNK_SIZE ? len : REPLY_CHUNK_SIZE;
+    ReplySegment *segment = (ReplySegment *)malloc(sizeof(ReplySegment) + capacity);
+    if (segment == NULL)
+    {
+        log_error("Failed to allocate reply buffer");
+        return;
+    }
+    memset(segment, 0, sizeof(ReplySegment));
+    segment->data = (char *)(segment + 1);
+    segment->capacity = capacity;
+    memcpy(segment->data, data, len);
+    segment->len = len;
+    queue_append(queue, segment);
+}
+
+// Append a reference to bytes held alive by `owner`
+void reply_add_ref(ReplyQueue *queue, const char *data, size_t len, void (*release)(void *owner), void *owner)
+{
+    ReplySegment *segment = (ReplySegment *)calloc(1, sizeof(ReplySegment));
+    if (segment == NULL)
+    {
+        log_error("Failed to allocate reply segment");
+        if (release)
+            release(owner);
+        return;
+    }
+    segment->data = (char *)data;
+    segment->len = len;
+    segment->release = release;
+    segment->owner = owner;
+    queue_append(queue, segment);
+}
+
+// Allocate a shared buffer for the caller to fill
+ReplyShared *reply_shared_new(size_t len)
+{
+    ReplyShared *shared = (ReplyShared *)malloc(sizeof(ReplyShared) + len);
+    if (shared == NULL)
+        return NULL;
+    shared->refcount = 1;
+    shared->len = len;
+    return shared;
+}
+
+// Drop one reference to a shared buffer
+void reply_shared_release(ReplyShared *shared)
+{
+    if (--shared->refcount == 0)
+        free(shared);
+}
+
+static void release_shared(void *owner)
+{
+    reply_shared_release((ReplyShared *)owner);
+}
+
+// Append a reference to a shared buffer
+void reply_add_shared(ReplyQueue *queue, ReplyShared *shared)
+{
+    shared->refcount++;
+    reply_add_ref(queue, shared->data, shared->len, release_shared, shared);
+}
+
+// Append a compressed value, decoded straight into a buffer the queue
+// references
+static void reply_add_decoded(ReplyQueue *queue, const KeyValue *node)
+{
+    if (node->flags & VALUE_FLAG_PLAIN)
+    {
+        ReplyShared *shared = reply_shared_new(node->raw_len + 3);
+        if (shared && db_decode(node, shared->data + 1) == 0)
+        {
+            shared->data[0] = '"';
+            memcpy(shared->data + 1 + node->raw_len, "\"\n", 2);
+            reply_add_ref(queue, shared->data, shared->len, release_shared, shared); // The queue takes our reference
+            return;
+        }
+        if (shared)
+            reply_shared_release(shared);
+    }
+    else
+    {
+        json_object *value = db_decode_value(node);
+        if (value)
+        {
+            size_t len;
+            const char *json = json_object_to_json_string_length(value, JSON_C_TO_STRING_SPACED, &len);
+            reply_add(queue, json, len);
+            reply_add(queue, "\n", 1);
+            json_object_put(value);
+            return;
+        }
+    }
+    log_error("Failed to decode the value of %s", node->key);
+    reply_add(queue, "ERROR\n", 6);
+}
+
+// Append a stored value followed by a newline
+void reply_add_value(ReplyQueue *queue, const KeyValue *node)
+{
+    json_object *value = node->value;
+    int flags = node->flags;
+
+    if (node->encoding != VALUE_ENCODING_RAW)
+    {
+        reply_add_decoded(queue, node);
+    }
+    else if (flags & VALUE_FLAG_PLAIN)
+    {
+        const char *data = json_object_get_string(value);
+        size_t len = json_object_get_string_len(value);
+
+        reply_add(queue, "\"", 1);
+        if (len >= REPLY_REF_MIN)
+            reply_add_ref(queue, data, len, release_value, json_object_get(value)); // Quote the stored bytes in place
+        else
+            reply_add(queue, data, len);
+        reply_add(queue, "\"\n", 2);
+    }
+    else
+    {
+        // The serialization buffer lives in the object and is rewritten on the
+        // next call, so it has to be copied
+        size_t len;
+        const char *json = json_object_to_json_string_length(value, JSON_C_TO_STRING_SPACED, &len);
+        reply_add(queue, json, len);
+        reply_add(queue, "\n", 1);
+    }
+}
+
+// Base64-encode len bytes into out, which has room for 4 * ((len + 2) / 3)
+static void base64_encode(const unsigned char *in, size_t len, char *out)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i = 0;
+    for (; i + 2 < len; i += 3)
+    {
+        unsigned int n = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+        *out++ = alphabet[n >> 18];
+        *out++ = alphabet[(n >> 12) & 63];
+        *out++ = alphabet[(n >> 6) & 63];
+        *out++ = alphabet[n & 63];
+    }
+    if (i < len)
+    {
+        unsigned int n = in[i] << 16;
+        if (i + 1 < len)
+            n |= in[i + 1] << 8;
+        *out++ = alphabet[n >> 18];
+        *out++ = alphabet[(n >> 12) & 63];
+        *out++ = i + 1 < len ? alphabet[(n >> 6) & 63] : '=';
+        *out++ = '=';
+    }
+}
+
+// Append a stored value as stored, described by its encoding
+void reply_add_encoded(ReplyQueue *queue, const KeyValue *node)
+{
+    if (node->encoding == VALUE_ENCODING_RAW)
+    {
+        json_object *reply = json_object_new_object();
+        json_object_object_add(reply, "encoding", json_object_new_string("raw"));
+        json_object_object_add(reply, "data", json_object_get(node->value));
+
+        size_t len;
+        const char *json = json_object_to_json_string_length(reply, JSON_C_TO_STRING_PLAIN, &len);
+        reply_add(queue, json, len);
+        reply_add(queue, "\n", 1);
+        json_object_put(reply);
+        return;
+    }
+
+    // The block is binary, so it travels as base64, encoded in one pass into
+    // a buffer the queue references
+    const unsigned char *data = (const unsigned char *)json_object_get_string(node->value);
+    size_t len = json_object_get_string_len(node->value);
+    char prefix[96];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "{\"encoding\":\"lz4\",\"length\":%zu,\"data\":\"", node->raw_len);
+    size_t encoded_len = 4 * ((len + 2) / 3);
+
+    ReplyShared *shared = reply_shared_new(prefix_len + encoded_len + 3);
+    if (shared == NULL)
+    {
+        reply_add(queue, "ERROR\n", 6);
+        return;
+    }
+    memcpy(shared->data, prefix, prefix_len);
+    base64_encode(data, len, shared->data + prefix_len);
+    memcpy(shared->data + prefix_len + encoded_len, "\"}\n", 3);
+    reply_add_ref(queue, shared->data, shared->len, release_shared, shared);
+}
+
+// Fill iovecs with queued output
+int reply_fill_iov(const ReplyQueue *queue, struct iovec *iov, int max)
+{
+    int n = 0;
+    size_t offset = queue->sent;
+    for (ReplySegment *segment = queue->head; segment && n < max; segment = segment->next)
+    {
+        iov[n].iov_base = segment->data + offset;
+        iov[n].iov_len = segment->len - offset;
+        offset = 0;
+        n++;
+    }
+    return n;
+}
+
+// Whether a large referenced segment is about to be written
+int reply_wants_zerocopy(const ReplyQueue *queue)
+{
+    int checked = 0;
+
+    if (zerocopy_threshold == 0 || queue->zc_enabled == -1)
+        return 0;
+    for (ReplySegment *segment = queue->head; segment && checked < REPLY_FLUSH_IOV; segment = segment->next, checked++)
+    {
+        if (segment->release && segment->len >= zerocopy_threshold)
+            return 1;
+    }
+    return 0;
+}
+
+// Hand a finished segment to the completion list or release it
+static void segment_done(ReplyQueue *queue, ReplySegment *segment)
+{
+    if (segment->zerocopy && (int32_t)(segment->zc_seq - queue->zc_completed) >= 0)
+    {
+        segment->next = NULL;
+        if (queue->zc_tail)
+            queue->zc_tail->next = segment;
+        else
+            queue->zc_head = segment;
+        queue->zc_tail = segment;
+        return;
+    }
+    segment_free(segment);
+}
+
+// Account for written bytes
+void reply_consume(ReplyQueue *queue, size_t len, int zerocopy)
+{
+    queue->bytes -= len;
+    while (len > 0 && queue->head)
+    {
+        ReplySegment *segment = queue->head;
+        size_t remaining = segment->len - queue->sent;
+
+        if (zerocopy)
+        {
+            segment->zerocopy = 1;
+            segment->zc_seq = queue->zc_issued - 1;
+        }
+        if (len < remaining)
+        {
+            queue->sent += len;
+            return;
+        }
+
+        len -= remaining;
+        queue->sent = 0;
+        queue->head = segment->next;
+        if (queue->head == NULL)
+            queue->tail = NULL;
+        segment_done(queue, segment);
+    }
+}
+
+// Release zerocopy segments whose sends have completed
+void reply_zerocopy_complete(ReplyQueue *queue, uint32_t completed)
+{
+    if ((int32_t)(completed - queue->zc_completed) > 0)
+        queue->zc_completed = completed;
+
+    while (queue->zc_head && (int32_t)(queue->zc_head->zc_seq - queue->zc_completed) < 0)
+    {
+        ReplySegment *segment = queue->zc_head;
+        queue->zc_head = segment->next;
+        if (queue->zc_head == NULL)
+            queue->zc_tail = NULL;
+        segment_free(segment);
+    }
+}
+
+// Whether zerocopy sends are still waiting on completion
+int reply_zerocopy_pending(const ReplyQueue *queue)
+{
+    return queue->zc_completed != queue->zc_issued;
+}
+
+// Turn on SO_ZEROCOPY the first time a socket needs it
+static int enable_zerocopy(int fd, ReplyQueue *queue)
+{
+    if (queue->zc_enabled == 0)
+    {
+#ifdef SO_ZEROCOPY
+        int one = 1;
+        queue->zc_enabled = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0 ? 1 : -1;
+#else
+        queue->zc_enabled = -1;
+#endif
+        if (queue->zc_enabled == -1)
+            log_info("SO_ZEROCOPY unavailable: %s", strerror(errno));
+    }
+    return queue->zc_enabled == 1;
+}
+
+// Write queued output to a non-blocking socket
+int reply_flush(int fd, ReplyQueue *queue)
+{
+    struct iovec iov[REPLY_FLUSH_IOV];
+
+    while (queue->bytes > 0)
+    {
+        struct msghdr msg;
+        int zerocopy = reply_wants_zerocopy(queue) && enable_zerocopy(fd, queue);
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = reply_fill_iov(queue, iov, REPLY_FLUSH_IOV);
+
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT | (zerocopy ? MSG_ZEROCOPY : 0));
+        if (sent == -1 && zerocopy && errno == ENOBUFS)
+        {
+            // Out of pinned-page budget: copy this write
+            zerocopy = 0;
+            sent = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+        if (sent == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 1;
+            log_error("Failed to send reply: %s", strerror(errno));
+            return -1;
+        }
+        if (zerocopy)
+            queue->zc_issued++;
+        reply_consume(queue, sent, zerocopy);
+    }
+    return 0;
+}
+
+// Read zerocopy completions from a socket's error queue
+void reply_zerocopy_reap(int fd, ReplyQueue *queue)
+{
+    char control[128];
+
+    while (reply_zerocopy_pending(queue))
+    {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+            break;
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY && serr->ee_errno == 0)
+                reply_zerocopy_complete(queue, serr->ee_data + 1);
+        }
+    }
+}
@@ -12,15 +12,41 @@
 #include "server.h"
 #include "log.h"
 #include "database.h"
+#include "client.h"
+#include "pubsub.h"
+#include "multi.h"
+#include "lazyfree.h"
+#include "repl.h"
+#include "net.h"
 #include "config.h"
 
+extern int use_io_uring;
+extern int use_key_filter;
+extern size_t compress_threshold;
+extern char *replicaof_host;
+extern int replicaof_port;
+
 int server_socket = -1;
+const NetBackend *net_backend = NULL;
 
 // Initialize the server components
 void init()
 {
     db_init();
+    if (use_key_filter)
+        db_enable_filter(KEY_FILTER_CAPACITY);
+    if (compress_threshold && db_enable_compression(compress_threshold) == -1)
+        printf("Built without LZ4, values are stored uncompressed\n");
     log_init();
+    repl_init();
+    if (replicaof_host)
+        repl_replicaof(replicaof_host, replicaof_port);
+}
+
+// Periodic work, run by the network backend about once a second
+void server_cron(void)
+{
+    repl_cron();
 }
 
 // Clean up server resources
@@ -30,7 +56,9 @@ void cleanup()
     {
         close(server_socket);
     }
+    client_free_all();
     db_cleanup();
+    lazyfree_shutdown();
     log_cleanup();
     exit(EXIT_SUCCESS);
 }
@@ -62,6 +90,10 @@ int start_server(int base_port)
             return -1;
         }
 
+        // Allow rebinding while closed connections sit in TIME_WAIT
+        int one = 1;
+        setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
         memset(&server_addr, 0, sizeof(server_addr));
         server_addr.sin_family = AF_INET;
         server_addr.sin_addr.s_addr = INADDR_ANY;
@@ -89,7 +121,7 @@ int start_server(int base_port)
         return -1;
     }
 
-    if (listen(server_socket, 10) == -1)
+    if (listen(server_socket, SOMAXCONN) == -1)
     {
         log_error("Listen error: %s", strerror(errno));
         close(server_socket);
@@ -101,150 +133,400 @@ int start_server(int base_port)
 }
 
 // Handle SET command: Store a key-value pair in the database
-void handle_set_command(int client_socket, const char *key, const char *value)
+void handle_set_command(Client *client, const char *key, const char *value)
 {
+    // The database may store a compressed copy instead, so keep our own
+    // reference for the replication stream
     json_object *json_value = json_object_new_string(value);
-    if (db_set(key, json_value) == 0)
+    if (db_set(key, json_object_get(json_value)) == 0)
     {
-        send(client_socket, "OK\n", 3, 0);
+        repl_propagate_set(key, json_value);
+        multi_touch_key(key);
+        reply_add(&client->out, "OK\n", 3);
         log_info("SET command successful for key: %s and value: %s", key, value);
     }
     else
     {
-        send(client_socket, "ERROR\n", 6, 0);
+        reply_add(&client->out, "ERROR\n", 6);
         log_error("SET command failed for key: %s and value: %s", key, value);
     }
+    json_object_put(json_value);
 }
 
-// Handle GET command: Retrieve a value from the database
-void handle_get_command(int client_socket, const char *key)
+// Handle GET command: Retrieve a value from the database, or with raw set,
+// the value as stored
+void handle_get_command(Client *client, const char *key, int raw)
 {
-    json_object *value_obj = db_get(key);
-    if (value_obj)
+    const KeyValue *node = db_lookup(key);
+    if (node)
     {
-        const char *value_str = json_object_to_json_string(value_obj);
-        send(client_socket, value_str, strlen(value_str), 0);
-        send(client_socket, "\n", 1, 0);
-        log_info("GET command successful for key: %s and value: %s", key, value_str);
+        if (raw)
+            reply_add_encoded(&client->out, node);
+        else
+            reply_add_value(&client->out, node);
+        log_info("GET command successful for key: %s", key);
     }
     else
     {
-        send(client_socket, "Not Found\n", 10, 0);
+        reply_add(&client->out, "Not Found\n", 10);
         log_info("GET command: key not found %s", key);
     }
 }
 
-// Handle DEL command
-void handle_del_command(int client_socket, const char *key)
+// Handle DEL and UNLINK commands; UNLINK frees large values in the background
+void handle_del_command(Client *client, const char *key, int lazy)
 {
-    if (db_delete(key) == 0)
+    // Watchers and replicas only hear of keys that were actually removed
+    if ((lazy ? db_unlink(key) : db_delete(key)) == 0)
     {
-        send(client_socket, "Deleted\n", 8, 0);
+        repl_propagate_del(key, lazy);
+        multi_touch_key(key);
+        reply_add(&client->out, "Deleted\n", 8);
         log_info("DEL command successful for key: %s", key);
     }
     else
     {
-        send(client_socket, "ERROR\n", 6, 0);
-        log_error("DEL command failed for key: %s", key);
+        reply_add(&client->out, "Not Found\n", 10);
+        log_info("DEL command: key not found %s", key);
     }
 }
 
-// Handle client connection and process commands
-void handle_client(int client_socket)
+// Handle FLUSHALL command: Remove every key, freeing them in the background
+// when the key is "ASYNC"
+void handle_flushall_command(Client *client, const char *mode)
+{
+    int async = mode != NULL && strcmp(mode, "ASYNC") == 0;
+    if (mode != NULL && !async && strcmp(mode, "SYNC") != 0)
+    {
+        reply_add(&client->out, "ERROR: FLUSHALL mode must be ASYNC or SYNC\n", 43);
+        return;
+    }
+
+    db_flush(async);
+    repl_propagate_flushall();
+    multi_touch_all();
+    reply_add(&client->out, "OK\n", 3);
+    log_info("FLUSHALL command successful");
+}
+
+// Add one key to a SCAN reply
+static void scan_key(const KeyValue *node, void *ctx)
+{
+    json_object_array_add((json_object *)ctx, json_object_new_string(node->key));
+}
+
+// Handle SCAN command: Return a chunk of keys after a cursor, and the cursor
+// to continue from, which is null once every key has been returned
+void handle_scan_command(Client *client, const char *cursor, const char *count_str)
 {
-    char buffer[BUFFER_SIZE];
-    int bytes_received = recv(client_socket, buffer, BUFFER_SIZE, 0);
+    long count = count_str ? atol(count_str) : 0;
+    if (count <= 0)
+        count = SCAN_DEFAULT_COUNT;
+    if (count > SCAN_MAX_COUNT)
+        count = SCAN_MAX_COUNT;
 
-    if (bytes_received > 0)
+    json_object *keys = json_object_new_array();
+    int more = db_scan(cursor, count, scan_key, keys);
+    size_t returned = json_object_array_length(keys);
+
+    json_object *reply = json_object_new_object();
+    json_object *last = returned ? json_object_array_get_idx(keys, returned - 1) : NULL;
+    json_object_object_add(reply, "cursor", more ? json_object_get(last) : NULL);
+    json_object_object_add(reply, "keys", keys);
+
+    size_t len;
+    const char *text = json_object_to_json_string_length(reply, JSON_C_TO_STRING_PLAIN, &len);
+    reply_add(&client->out, text, len);
+    reply_add(&client->out, "\n", 1);
+    json_object_put(reply);
+}
+
+// Handle STATS command: Report database statistics as a JSON object
+void handle_stats_command(Client *client)
+{
+    DbStats stats;
+    ReplStats repl;
+    size_t channels, patterns;
+    db_stats(&stats);
+    repl_stats(&repl);
+    pubsub_counts(&channels, &patterns);
+
+    json_object *reply = json_object_new_object();
+    json_object_object_add(reply, "keys", json_object_new_uint64(stats.keys));
+    json_object_object_add(reply, "lazyfree_pending_objects", json_object_new_uint64(lazyfree_pending()));
+    json_object_object_add(reply, "pubsub_channels", json_object_new_uint64(channels));
+    json_object_object_add(reply, "pubsub_patterns", json_object_new_uint64(patterns));
+    json_object_object_add(reply, "role", json_object_new_string(repl.replica ? "replica" : "primary"));
+    json_object_object_add(reply, "repl_id", json_object_new_string(repl.replid));
+    json_object_object_add(reply, "repl_offset", json_object_new_uint64(repl.offset));
+    json_object_object_add(reply, "repl_backlog_bytes", json_object_new_uint64(repl.backlog_bytes));
+    json_object_object_add(reply, "connected_replicas", json_object_new_uint64(repl.replicas));
+    json_object_object_add(reply, "full_syncs", json_object_new_uint64(repl.full_syncs));
+    json_object_object_add(reply, "partial_syncs", json_object_new_uint64(repl.partial_syncs));
+    if (repl.replica)
+    {
+        json_object_object_add(reply, "master_host", json_object_new_string(repl.master_host));
+        json_object_object_add(reply, "master_port", json_object_new_int(repl.master_port));
+        json_object_object_add(reply, "master_link_up", json_object_new_boolean(repl.master_link_up));
+    }
+    json_object_object_add(reply, "compress_threshold", json_object_new_uint64(stats.compress_threshold));
+    json_object_object_add(reply, "compressed_values", json_object_new_uint64(stats.compressed_values));
+    json_object_object_add(reply, "compressed_bytes", json_object_new_uint64(stats.compressed_bytes));
+    json_object_object_add(reply, "compressed_raw_bytes", json_object_new_uint64(stats.compressed_raw_bytes));
+    json_object_object_add(reply, "compression_ratio",
+                           json_object_new_double(stats.compressed_bytes ? (double)stats.compressed_raw_bytes / stats.compressed_bytes : 1.0));
+    json_object_object_add(reply, "filter_enabled", json_object_new_boolean(stats.filter_enabled));
+    if (stats.filter_enabled)
     {
-        buffer[bytes_received] = '\0';
-        log_info("Received data: %s\n", buffer);
+        // Observed rate: share of missing keys the filter failed to reject
+        unsigned long long misses = stats.filter_negatives + stats.filter_false_positives;
+        double fp_rate = misses ? (double)stats.filter_false_positives / misses : 0.0;
 
-        // Parse JSON command
-        struct json_object *parsed_json;
-        struct json_object *key_obj;
-        struct json_object *operation_obj;
-        struct json_object *value_obj;
+        json_object_object_add(reply, "filter_capacity", json_object_new_uint64(stats.filter_capacity));
+        json_object_object_add(reply, "filter_items", json_object_new_uint64(stats.filter_items));
+        json_object_object_add(reply, "filter_bytes", json_object_new_uint64(stats.filter_bytes));
+        json_object_object_add(reply, "filter_lookups", json_object_new_uint64(stats.filter_lookups));
+        json_object_object_add(reply, "filter_negatives", json_object_new_uint64(stats.filter_negatives));
+        json_object_object_add(reply, "filter_false_positives", json_object_new_uint64(stats.filter_false_positives));
+        json_object_object_add(reply, "filter_fp_rate", json_object_new_double(fp_rate));
+    }
 
-        parsed_json = json_tokener_parse(buffer);
-        if (parsed_json == NULL)
-        {
-            log_error("Failed to parse JSON\n");
-            send(client_socket, "ERROR: Invalid JSON", 19, 0);
-            close(client_socket);
-            return;
-        }
+    size_t len;
+    const char *text = json_object_to_json_string_length(reply, JSON_C_TO_STRING_PLAIN, &len);
+    reply_add(&client->out, text, len);
+    reply_add(&client->out, "\n", 1);
+    json_object_put(reply);
+}
+
+// Handle PUBLISH command: Fan a message out and reply with the number of deliveries
+void handle_publish_command(Client *client, const char *channel, const char *message)
+{
+    char reply[32];
+    size_t delivered = pubsub_publish(client, channel, message);
+    int len = snprintf(reply, sizeof(reply), "%zu\n", delivered);
+    reply_add(&client->out, reply, len);
+    log_info("PUBLISH to %s reached %zu subscribers", channel, delivered);
+}
 
-        // Extract command components
-        json_object_object_get_ex(parsed_json, "key", &key_obj);
-        json_object_object_get_ex(parsed_json, "operation", &operation_obj);
+// Handle REPLICAOF command: Follow a primary given as key (host) and value
+// (port), or stop replicating with the key "NO ONE"
+void handle_replicaof_command(Client *client, const char *host, const char *port)
+{
+    if (strcmp(host, "NO ONE") == 0)
+    {
+        repl_replicaof(NULL, 0);
+        reply_add(&client->out, "OK\n", 3);
+        return;
+    }
 
-        const char *key_str = json_object_get_string(key_obj);
-        const char *op_str = json_object_get_string(operation_obj);
+    int port_num = port ? atoi(port) : 0;
+    if (port_num <= 0 || port_num > 65535 || repl_replicaof(host, port_num) == -1)
+    {
+        reply_add(&client->out, "ERROR: Invalid primary address\n", 31);
+        return;
+    }
+    reply_add(&client->out, "OK\n", 3);
+}
 
-        if (key_str == NULL || op_str == NULL)
-        {
-            log_error("Key or operation missing in JSON\n");
-            send(client_socket, "ERROR: Key or operation missing", 31, 0);
-            close(client_socket);
-            json_object_put(parsed_json);
-            return;
-        }
+// Execute one parsed command, queueing its reply on the client
+void execute_command(Client *client, struct json_object *parsed_json)
+{
+    struct json_object *key_obj;
+    struct json_object *operation_obj;
+    struct json_object *value_obj;
 
-        // Process the command
-        if (strcmp(op_str, "GET") == 0)
-        {
-            handle_get_command(client_socket, key_str);
-        }
-        else if (strcmp(op_str, "DEL") == 0)
-        {
-            handle_del_command(client_socket, key_str);
-        }
-        else if (strcmp(op_str, "SET") == 0)
+    // The primary's stream is applied without replies, and replicas only
+    // listen once they have sent PSYNC
+    if (client->flags & CLIENT_MASTER)
+    {
+        repl_apply(client, parsed_json);
+        return;
+    }
+    if (client->flags & CLIENT_REPLICA)
+        return;
+
+    // Extract command components
+    json_object_object_get_ex(parsed_json, "key", &key_obj);
+    json_object_object_get_ex(parsed_json, "operation", &operation_obj);
+
+    const char *key_str = json_object_get_string(key_obj);
+    const char *op_str = json_object_get_string(operation_obj);
+
+    // Inside MULTI everything but the transaction commands is queued
+    if (client->flags & CLIENT_MULTI && op_str != NULL && strcmp(op_str, "EXEC") != 0 &&
+        strcmp(op_str, "DISCARD") != 0 && strcmp(op_str, "MULTI") != 0 && strcmp(op_str, "WATCH") != 0)
+    {
+        multi_queue(client, parsed_json);
+        return;
+    }
+
+    // Operations that work without a key; unsubscribing without one drops
+    // every subscription of that kind
+    if (op_str != NULL && strcmp(op_str, "MULTI") == 0)
+    {
+        multi_begin(client);
+        return;
+    }
+    if (op_str != NULL && strcmp(op_str, "EXEC") == 0)
+    {
+        multi_exec(client);
+        return;
+    }
+    if (op_str != NULL && strcmp(op_str, "DISCARD") == 0)
+    {
+        multi_discard(client);
+        return;
+    }
+    if (op_str != NULL && strcmp(op_str, "UNWATCH") == 0)
+    {
+        multi_unwatch(client);
+        reply_add(&client->out, "OK\n", 3);
+        return;
+    }
+    if (op_str != NULL && strcmp(op_str, "BATCH") == 0)
+    {
+        multi_batch(client, parsed_json);
+        return;
+    }
+    if (op_str != NULL && strcmp(op_str, "STATS") == 0)
+    {
+        handle_stats_command(client);
+        return;
+    }
+    if (op_str != NULL && strcmp(op_str, "SCAN") == 0)
+    {
+        json_object_object_get_ex(parsed_json, "value", &value_obj);
+        handle_scan_command(client, key_str, json_object_get_string(value_obj));
+        return;
+    }
+    if (op_str != NULL && strcmp(op_str, "FLUSHALL") == 0)
+    {
+        if (repl_is_replica())
+            reply_add(&client->out, "ERROR: Read-only replica\n", 25);
+        else
+            handle_flushall_command(client, key_str);
+        return;
+    }
+    if (op_str != NULL && strcmp(op_str, "UNSUBSCRIBE") == 0)
+    {
+        pubsub_unsubscribe(client, key_str, 0);
+        return;
+    }
+    if (op_str != NULL && strcmp(op_str, "PUNSUBSCRIBE") == 0)
+    {
+        pubsub_unsubscribe(client, key_str, 1);
+        return;
+    }
+
+    if (key_str == NULL || op_str == NULL)
+    {
+        log_error("Key or operation missing in JSON\n");
+        reply_add(&client->out, "ERROR: Key or operation missing\n", 32);
+        return;
+    }
+
+    // Process the command
+    if (strcmp(op_str, "GET") == 0)
+    {
+        json_object_object_get_ex(parsed_json, "value", &value_obj);
+        const char *mode = json_object_get_string(value_obj);
+        handle_get_command(client, key_str, mode != NULL && strcmp(mode, "RAW") == 0);
+    }
+    else if ((strcmp(op_str, "SET") == 0 || strcmp(op_str, "DEL") == 0 || strcmp(op_str, "UNLINK") == 0) &&
+             repl_is_replica())
+    {
+        reply_add(&client->out, "ERROR: Read-only replica\n", 25);
+    }
+    else if (strcmp(op_str, "DEL") == 0)
+    {
+        handle_del_command(client, key_str, 0);
+    }
+    else if (strcmp(op_str, "UNLINK") == 0)
+    {
+        handle_del_command(client, key_str, 1);
+    }
+    else if (strcmp(op_str, "SET") == 0)
+    {
+        json_object_object_get_ex(parsed_json, "value", &value_obj);
+        const char *value_str = json_object_get_string(value_obj);
+        if (value_str == NULL)
         {
-            json_object_object_get_ex(parsed_json, "value", &value_obj);
-            const char *value_str = json_object_get_string(value_obj);
-            handle_set_command(client_socket, key_str, value_str);
+            log_error("Value missing in JSON\n");
+            reply_add(&client->out, "ERROR: Value missing\n", 21);
+            return;
         }
-        else
+        handle_set_command(client, key_str, value_str);
+    }
+    else if (strcmp(op_str, "PSYNC") == 0)
+    {
+        json_object_object_get_ex(parsed_json, "value", &value_obj);
+        repl_psync(client, key_str, json_object_get_string(value_obj));
+    }
+    else if (strcmp(op_str, "REPLICAOF") == 0)
+    {
+        json_object_object_get_ex(parsed_json, "value", &value_obj);
+        handle_replicaof_command(client, key_str, json_object_get_string(value_obj));
+    }
+    else if (strcmp(op_str, "WATCH") == 0)
+    {
+        multi_watch(client, key_str);
+    }
+    else if (strcmp(op_str, "SUBSCRIBE") == 0)
+    {
+        pubsub_subscribe(client, key_str, 0);
+    }
+    else if (strcmp(op_str, "PSUBSCRIBE") == 0)
+    {
+        pubsub_subscribe(client, key_str, 1);
+    }
+    else if (strcmp(op_str, "PUBLISH") == 0)
+    {
+        json_object_object_get_ex(parsed_json, "value", &value_obj);
+        const char *value_str = json_object_get_string(value_obj);
+        if (value_str == NULL)
         {
-            log_error("Unknown operation\n");
-            send(client_socket, "ERROR: Unknown operation", 25, 0);
+            log_error("Value missing in JSON\n");
+            reply_add(&client->out, "ERROR: Value missing\n", 21);
+            return;
         }
-        json_object_put(parsed_json);
+        handle_publish_command(client, key_str, value_str);
     }
     else
     {
-        log_error("Failed to receive data\n");
-        send(client_socket, "ERROR: Failed to receive data", 30, 0);
+        log_error("Unknown operation\n");
+        reply_add(&client->out, "ERROR: Unknown operation\n", 25);
     }
-    close(client_socket);
 }
 
-// Main loop to accept and handle client connections
+// Serve client connections with the selected network backend, falling back
+// to epoll when io_uring is unavailable
 void accept_connections()
 {
-    struct sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int client_socket;
-
-    while (1)
+    if (server_socket < 0)
     {
-        if (server_socket < 0)
-        {
-            log_error("Invalid server_socket. Connections cannot be accepted.");
-            break;
-        }
+        log_error("Invalid server_socket. Connections cannot be accepted.");
+        cleanup();
+    }
 
-        client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &client_len);
-        if (client_socket < 0)
-        {
-            log_error("Client accept failed: %s", strerror(errno));
-            continue;
-        }
-        handle_client(client_socket);
+    net_backend = use_io_uring ? &net_uring : &net_epoll;
+    if (net_backend->init(server_socket) == -1 && net_backend == &net_uring)
+    {
+        printf("io_uring unavailable, falling back to epoll\n");
+        net_backend = &net_epoll;
+        if (net_backend->init(server_socket) == -1)
+            net_backend = NULL;
     }
-    close(client_socket);
+    if (net_backend == NULL)
+    {
+        log_error("No network backend available");
+        cleanup();
+    }
+
+    printf("Network backend: %s\n", net_backend->name);
+    fflush(stdout);
+    server_cron();
+    net_backend->run();
+
     log_info("Server is shutting down, performing clean-up...");
     cleanup();
 }
@@ -5,14 +5,22 @@ This file contains various tests to ensure the correct functionality,
 performance, and fault tolerance of the Mini-Redis server.
 """
 
+import base64
+import contextlib
+import json
+import os
 import socket
+import subprocess
 import time
+import threading
 import tracemalloc
 import random
 import string
 import pytest
 
 PORT = 45234
+SERVER_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "mini-redis")
+NETBENCH_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "mini-redis-netbench")
 BUFFER_SIZE = 1024
 
 def setup_module(module):
@@ -34,6 +42,58 @@ def send_command(command):
     except socket.error as e:
         pytest.fail(f"Socket error occurred: {e}")
 
+def send_command_full(command, port=PORT):
+    """Send a command and read the whole newline-terminated response."""
+    try:
+        with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+            s.connect(("127.0.0.1", port))
+            s.sendall(command.encode())
+            chunks = []
+            while True:
+                chunk = s.recv(65536)
+                if not chunk:
+                    break
+                chunks.append(chunk)
+                if chunk.endswith(b"\n"):
+                    break
+        return b"".join(chunks).decode().strip()
+    except socket.error as e:
+        pytest.fail(f"Socket error occurred: {e}")
+
+def wait_for(condition, timeout=10):
+    """Poll a condition until it holds or the timeout passes."""
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if condition():
+            return True
+        time.sleep(0.1)
+    return False
+
+def server_stats(port):
+    """STATS of a server, or an empty dict while it is still starting up."""
+    try:
+        socket.create_connection(("127.0.0.1", port)).close()
+    except OSError:
+        return {}
+    return json.loads(send_command_full('{"operation": "STATS"}', port))
+
+@contextlib.contextmanager
+def replica_server(*args, primary=f"127.0.0.1:{PORT}"):
+    """Run a second server replicating from the primary, yielding its port."""
+    # Let the kernel pick a port no client socket is using
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+        s.bind(("127.0.0.1", 0))
+        replica_port = s.getsockname()[1]
+
+    replica = subprocess.Popen(
+        [SERVER_PATH, "-p", str(replica_port), *args, "-r", primary], stdout=subprocess.DEVNULL
+    )
+    try:
+        yield replica_port
+    finally:
+        replica.terminate()
+        replica.wait()
+
 # Generate a random string for testing
 def generate_random_string(length=10):
     """Generate a random string for testing purposes."""
@@ -61,6 +121,11 @@ def test_basic_operations():
     response = send_command('{"key": "key1", "operation": "GET"}')
     assert response == "Not Found", f"GET command failed: {response}"
 
+    # Deleting a key that is gone reports it, which miniredis_del returns as 0
+    for operation in ("DEL", "UNLINK"):
+        response = send_command(f'{{"key": "key1", "operation": "{operation}"}}')
+        assert response == "Not Found", f"{operation} of a missing key: {response}"
+
 # Test AVL tree resizing and data integrity
 def test_resize_avl_tree():
     """Test AVL tree resizing and data integrity with a large number of insertions."""
@@ -84,6 +149,400 @@ def test_resize_avl_tree():
             response == f'"{expected_value}"'
         ), f"GET command failed for {key}: {response}"
 
+# Test values larger than one read buffer, including zerocopy-sized replies
+def test_large_values():
+    """Test that large values round-trip and escaped values are still valid JSON."""
+    for size in (4096, 200 * 1024):
+        value = generate_random_string(size)
+        response = send_command_full(f'{{"key": "big{size}", "operation": "SET", "value": "{value}"}}')
+        assert response == "OK", f"SET command failed for {size} bytes: {response}"
+        response = send_command_full(f'{{"key": "big{size}", "operation": "GET"}}')
+        assert response == f'"{value}"', f"GET command failed for {size} bytes"
+
+    response = send_command('{"key": "escaped", "operation": "SET", "value": "a/b \\"c\\""}')
+    assert response == "OK", f"SET command failed: {response}"
+    response = send_command('{"key": "escaped", "operation": "GET"}')
+    assert response == '"a\\/b \\"c\\""', f"GET command failed: {response}"
+
+# Test several commands on one persistent connection
+def test_persistent_connection():
+    """Test pipelined commands on a single connection, answered in order."""
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+        s.connect(("127.0.0.1", PORT))
+        commands = "".join(
+            f'{{"key": "pipe{i}", "operation": "SET", "value": "value{i}"}}' for i in range(100)
+        )
+        commands += "".join(f'{{"key": "pipe{i}", "operation": "GET"}}\n' for i in range(100))
+        s.sendall(commands.encode())
+
+        data = b""
+        while data.count(b"\n") < 200:
+            chunk = s.recv(BUFFER_SIZE)
+            assert chunk, "Connection closed before all replies arrived"
+            data += chunk
+        lines = data.decode().split("\n")
+
+    assert lines[:100] == ["OK"] * 100, "Pipelined SET commands failed"
+    assert lines[100:200] == [f'"value{i}"' for i in range(100)], "Pipelined GET commands failed"
+
+# Test that a client pipelining without reading is paused, not buffered without bound
+def test_output_backpressure():
+    """Test that reading resumes and every reply arrives once a slow reader catches up."""
+    assert send_command(json.dumps({"key": "slowreader", "operation": "SET", "value": "x" * 200})) == "OK"
+    count = 100000  # About 20MB of replies, well past the point where reading stops
+    commands = b'{"key": "slowreader", "operation": "GET"}' * count
+
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+        s.connect(("127.0.0.1", PORT))
+        writer = threading.Thread(target=s.sendall, args=(commands,))
+        writer.start()
+        time.sleep(0.5)
+
+        # Other clients are served while this one is paused
+        assert json.loads(send_command('{"key": "slowreader", "operation": "GET"}')) == "x" * 200
+
+        replies = 0
+        while replies < count:
+            chunk = s.recv(1 << 20)
+            assert chunk, "Connection closed before all replies arrived"
+            replies += chunk.count(b"\n")
+        writer.join()
+    assert replies == count
+
+# Test the STATS operation and the key filter behind it
+def test_stats():
+    """Test that STATS tracks the key count and, when enabled, filter misses."""
+    before = json.loads(send_command_full('{"operation": "STATS"}'))
+    assert send_command('{"key": "stats_key", "operation": "SET", "value": "v"}') == "OK"
+    assert send_command('{"key": "stats_missing", "operation": "GET"}') == "Not Found"
+    after = json.loads(send_command_full('{"operation": "STATS"}'))
+    assert after["keys"] == before["keys"] + 1, "SET of a new key not counted"
+
+    if after["filter_enabled"]:
+        assert after["filter_items"] == after["keys"], "Filter out of sync with the keyspace"
+        misses = lambda s: s["filter_negatives"] + s["filter_false_positives"]
+        assert misses(after) == misses(before) + 1, "Miss not counted by the filter"
+        assert 0.0 <= after["filter_fp_rate"] <= 1.0
+
+    assert send_command('{"key": "stats_key", "operation": "DEL"}') == "Deleted"
+    response = json.loads(send_command_full('{"operation": "STATS"}'))
+    assert response["keys"] == before["keys"], "DEL of a key not counted"
+
+# Test Pub/Sub fan-out to channel and pattern subscribers
+def test_pubsub():
+    """Test that PUBLISH reaches channel and pattern subscribers with one delivery each."""
+    def read_lines(sock, count):
+        data = b""
+        while data.count(b"\n") < count:
+            chunk = sock.recv(BUFFER_SIZE)
+            assert chunk, "Connection closed before all replies arrived"
+            data += chunk
+        return [json.loads(line) for line in data.decode().split("\n")[:count]]
+
+    with socket.create_connection(("127.0.0.1", PORT)) as channel_sub, \
+         socket.create_connection(("127.0.0.1", PORT)) as pattern_sub:
+        channel_sub.sendall(b'{"key": "events", "operation": "SUBSCRIBE"}')
+        assert read_lines(channel_sub, 1) == [{"type": "subscribe", "channel": "events", "count": 1}]
+        pattern_sub.sendall(b'{"key": "ev*", "operation": "PSUBSCRIBE"}')
+        assert read_lines(pattern_sub, 1) == [{"type": "psubscribe", "pattern": "ev*", "count": 1}]
+
+        response = send_command('{"key": "events", "operation": "PUBLISH", "value": "invalidate user:1"}')
+        assert response == "2", f"PUBLISH reached wrong number of subscribers: {response}"
+        assert read_lines(channel_sub, 1) == [{"type": "message", "channel": "events", "message": "invalidate user:1"}]
+        assert read_lines(pattern_sub, 1) == [
+            {"type": "pmessage", "pattern": "ev*", "channel": "events", "message": "invalidate user:1"}
+        ]
+
+        channel_sub.sendall(b'{"operation": "UNSUBSCRIBE"}')
+        assert read_lines(channel_sub, 1) == [{"type": "unsubscribe", "channel": "events", "count": 0}]
+        response = send_command('{"key": "events", "operation": "PUBLISH", "value": "again"}')
+        assert response == "1", f"PUBLISH after UNSUBSCRIBE: {response}"
+
+# Test MULTI/EXEC, WATCH and BATCH
+def test_transactions():
+    """Test that queued commands run together, and that a changed watched key aborts EXEC."""
+    def run(sock, commands, count):
+        sock.sendall("".join(commands).encode())
+        data = b""
+        while data.count(b"\n") < count:
+            chunk = sock.recv(BUFFER_SIZE)
+            assert chunk, "Connection closed before all replies arrived"
+            data += chunk
+        return data.decode().split("\n")[:count]
+
+    with socket.create_connection(("127.0.0.1", PORT)) as s:
+        lines = run(s, [
+            '{"operation": "MULTI"}',
+            '{"key": "tx1", "operation": "SET", "value": "a"}',
+            '{"key": "tx2", "operation": "SET", "value": "b"}',
+            '{"key": "tx1", "operation": "GET"}',
+            '{"operation": "EXEC"}',
+        ], 7)
+        assert lines == ["OK", "QUEUED", "QUEUED", "QUEUED", "OK", "OK", '"a"'], f"MULTI/EXEC failed: {lines}"
+
+        # A write from another connection invalidates the watch
+        lines = run(s, ['{"key": "tx1", "operation": "WATCH"}', '{"operation": "MULTI"}'], 2)
+        assert lines == ["OK", "OK"]
+        assert send_command('{"key": "tx1", "operation": "SET", "value": "other"}') == "OK"
+        lines = run(s, ['{"key": "tx1", "operation": "DEL"}', '{"operation": "EXEC"}'], 2)
+        assert lines[0] == "QUEUED" and lines[1].startswith("ERROR"), f"EXEC ran after watched key changed: {lines}"
+        assert send_command('{"key": "tx1", "operation": "GET"}') == '"other"'
+
+        # Deleting a key that does not exist changes nothing, so the watch holds
+        lines = run(s, ['{"key": "tx_missing", "operation": "WATCH"}', '{"operation": "MULTI"}'], 2)
+        assert lines == ["OK", "OK"]
+        send_command('{"key": "tx_missing", "operation": "DEL"}')
+        send_command('{"key": "tx_missing", "operation": "UNLINK"}')
+        lines = run(s, ['{"key": "tx_missing", "operation": "GET"}', '{"operation": "EXEC"}'], 2)
+        assert lines == ["QUEUED", "Not Found"], f"DEL of a missing key aborted EXEC: {lines}"
+
+        # UNWATCH inside MULTI is queued rather than spoiling the transaction
+        lines = run(s, ['{"operation": "MULTI"}', '{"operation": "UNWATCH"}', '{"key": "tx1", "operation": "GET"}',
+                        '{"operation": "EXEC"}'], 5)
+        assert lines == ["OK", "QUEUED", "QUEUED", "OK", '"other"'], f"UNWATCH inside MULTI: {lines}"
+
+        lines = run(s, ['{"operation": "MULTI"}', '{"key": "tx1", "operation": "SUBSCRIBE"}', '{"operation": "EXEC"}'], 3)
+        assert lines[0] == "OK" and lines[1].startswith("ERROR") and lines[2].startswith("ERROR")
+
+    response = send_command_full(json.dumps({"operation": "BATCH", "commands": [
+        {"key": "tx2", "operation": "DEL"},
+        {"key": "tx3", "operation": "SET", "value": "c"},
+    ]}))
+    assert response.split("\n")[:2] == ["Deleted", "OK"], f"BATCH failed: {response}"
+    response = send_command(json.dumps({"operation": "BATCH", "commands": [
+        {"key": "tx3", "operation": "DEL"},
+        {"key": "tx4", "operation": "SET"},
+    ]}))
+    assert response.startswith("ERROR"), f"Invalid BATCH accepted: {response}"
+    assert send_command('{"key": "tx3", "operation": "GET"}') == '"c"', "Invalid BATCH was partly applied"
+
+# Test SCAN, UNLINK and FLUSHALL ASYNC
+def test_scan_and_flush():
+    """Test that SCAN returns every key once in bounded chunks, and that UNLINK and FLUSHALL remove keys."""
+    keys = [f"scan{i:03d}" for i in range(50)]
+    for key in keys:
+        assert send_command(f'{{"key": "{key}", "operation": "SET", "value": "{"x" * 100000}"}}') == "OK"
+    assert send_command('{"key": "scan010", "operation": "UNLINK"}') == "Deleted"
+    keys.remove("scan010")
+
+    seen = []
+    cursor = None
+    while True:
+        command = {"operation": "SCAN", "value": "7"}
+        if cursor is not None:
+            command["key"] = cursor
+        response = json.loads(send_command_full(json.dumps(command)))
+        assert len(response["keys"]) <= 7, "SCAN returned more keys than asked for"
+        seen += response["keys"]
+        # Keys added mid-scan must not disturb the cursor
+        assert send_command(f'{{"key": "scan_new{len(seen)}", "operation": "SET", "value": "v"}}') == "OK"
+        cursor = response["cursor"]
+        if cursor is None:
+            break
+    scanned = [key for key in seen if key in keys]
+    assert scanned == keys, "SCAN missed or repeated keys"
+    assert seen == sorted(set(seen)), "SCAN returned keys out of order"
+
+    assert send_command('{"key": "ASYNC", "operation": "FLUSHALL"}') == "OK"
+    assert send_command('{"key": "scan000", "operation": "GET"}') == "Not Found"
+    stats = json.loads(send_command_full('{"operation": "STATS"}'))
+    assert stats["keys"] == 0, "FLUSHALL left keys behind"
+    assert json.loads(send_command_full('{"operation": "SCAN"}')) == {"cursor": None, "keys": []}
+
+# Test replication to a second server process
+def test_replication():
+    """Test full sync, streamed writes and read-only mode on a replica of the test server."""
+    for i in range(50):
+        assert send_command(f'{{"key": "repl{i}", "operation": "SET", "value": "value{i}"}}') == "OK"
+
+    with replica_server() as replica_port:
+        assert wait_for(lambda: server_stats(replica_port).get("master_link_up")), "Replica did not sync"
+        for i in range(50):
+            response = send_command_full(f'{{"key": "repl{i}", "operation": "GET"}}', replica_port)
+            assert response == f'"value{i}"', f"Snapshot missing repl{i}: {response}"
+
+        # Writes after the snapshot are streamed
+        assert send_command('{"key": "repl0", "operation": "SET", "value": "updated"}') == "OK"
+        assert send_command('{"key": "repl1", "operation": "DEL"}') == "Deleted"
+        assert wait_for(
+            lambda: send_command_full('{"key": "repl0", "operation": "GET"}', replica_port) == '"updated"'
+        ), "SET not replicated"
+        assert wait_for(
+            lambda: send_command_full('{"key": "repl1", "operation": "GET"}', replica_port) == "Not Found"
+        ), "DEL not replicated"
+
+        # Deleting a key that does not exist is not replicated
+        offset = server_stats(PORT)["repl_offset"]
+        send_command('{"key": "repl_missing", "operation": "DEL"}')
+        send_command('{"key": "repl_missing", "operation": "UNLINK"}')
+        assert server_stats(PORT)["repl_offset"] == offset, "DEL of a missing key was replicated"
+
+        response = send_command_full('{"key": "repl2", "operation": "SET", "value": "x"}', replica_port)
+        assert response == "ERROR: Read-only replica", f"Replica accepted a write: {response}"
+
+# Test that a replica cut off mid-snapshot does not resume its partial keyspace
+def test_replication_interrupted_snapshot():
+    """Test that a snapshot broken off by the primary forces a full resync."""
+    def read_message(conn):
+        """Read one JSON message from a stream without separators."""
+        data = b""
+        while True:
+            chunk = conn.recv(4096)
+            assert chunk, "Replica closed the link"
+            data += chunk
+            try:
+                return json.JSONDecoder().raw_decode(data.decode())[0]
+            except ValueError:
+                continue
+
+    def set_command(key, value):
+        return json.dumps({"key": key, "operation": "SET", "value": value}, separators=(",", ":")).encode()
+
+    # A fake primary that scripts exactly what the replica receives
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as listener:
+        listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        listener.bind(("127.0.0.1", 0))
+        listener.listen(1)
+        listener.settimeout(10)
+        primary = f"127.0.0.1:{listener.getsockname()[1]}"
+
+        with replica_server(primary=primary) as replica_port:
+            # Start a snapshot, send 3 keys, then drop the link before its end
+            conn, _ = listener.accept()
+            with conn:
+                assert read_message(conn)["operation"] == "PSYNC"
+                header = {"type": "fullresync", "replid": "a" * 40, "offset": 1000}
+                conn.sendall(json.dumps(header).encode())
+                for i in range(3):
+                    conn.sendall(set_command(f"partial{i}", "x"))
+                assert wait_for(lambda: server_stats(replica_port).get("keys") == 3), "Snapshot keys not loaded"
+
+            # The replica must not claim the history it only half received
+            conn, _ = listener.accept()
+            with conn:
+                psync = read_message(conn)
+                assert psync["key"] != "a" * 40 and psync["value"] == "0", f"Replica resumed a partial snapshot: {psync}"
+
+                header = {"type": "fullresync", "replid": "b" * 40, "offset": 0}
+                conn.sendall(json.dumps(header).encode() + set_command("complete", "y") + b'{"type":"snapshot_end"}')
+                assert wait_for(lambda: server_stats(replica_port).get("master_link_up")), "Replica did not sync"
+                assert server_stats(replica_port)["keys"] == 1, "Partial snapshot keys survived the resync"
+
+                # Writes after the snapshot advance the offset rather than the snapshot count
+                command = set_command("streamed", "z")
+                conn.sendall(command)
+                assert wait_for(
+                    lambda: server_stats(replica_port).get("repl_offset") == len(command)
+                ), "Streamed write was counted as part of the snapshot"
+
+# Test that writes made while a snapshot is sent follow it on the stream
+def test_replication_snapshot_with_writes():
+    """Test that a snapshot stalled by a slow replica still ends up consistent."""
+    value = "v" * 1000
+    keys = [f"snap{i:05}" for i in range(10000)]
+
+    def pipeline(commands):
+        with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+            s.connect(("127.0.0.1", PORT))
+            s.sendall("".join(json.dumps(command) for command in commands).encode())
+            received = b""
+            while received.count(b"\n") < len(commands):
+                received += s.recv(65536)
+
+    pipeline([{"key": key, "operation": "SET", "value": value} for key in keys])
+
+    # A replica with a tiny receive window that stops reading after the
+    # header, so the snapshot of ~10MB is stuck partway through
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as replica:
+        replica.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+        replica.settimeout(10)
+        replica.connect(("127.0.0.1", PORT))
+        replica.sendall(json.dumps({"key": "0" * 40, "operation": "PSYNC", "value": "0"}).encode())
+        stream = replica.recv(4096)
+        assert stream.startswith(b'{"type":"fullresync"'), f"Unexpected reply to PSYNC: {stream[:100]}"
+
+        # Overwrite and delete keys on both sides of wherever the snapshot has got to
+        writes = []
+        for i in range(0, len(keys), 500):
+            writes.append({"key": keys[i], "operation": "SET", "value": f"new{i}"})
+            writes.append({"key": keys[i + 1], "operation": "DEL"})
+        pipeline(writes)
+
+        end = b'{"type":"snapshot_end"}'
+        expected = server_stats(PORT)["repl_offset"] - json.loads(stream[:stream.index(b"}") + 1])["offset"]
+        while end not in stream or len(stream) - stream.index(end) - len(end) < expected:
+            chunk = replica.recv(1 << 20)
+            assert chunk, "Primary closed the replication link"
+            stream += chunk
+
+    # Apply the stream as a replica would
+    text, position, state = stream.decode(), 0, {}
+    decoder = json.JSONDecoder()
+    while position < len(text):
+        message, position = decoder.raw_decode(text, position)
+        if message.get("operation") == "SET":
+            state[message["key"]] = message["value"]
+        elif message.get("operation") == "DEL":
+            state.pop(message["key"], None)
+
+    snapshot_end = text.index(end.decode())
+    assert len(text) - snapshot_end - len(end) == expected, "Stream after the snapshot does not match the offset"
+    assert '"operation":"DEL"' not in text[:snapshot_end], "A write was sent inside the snapshot"
+    for i, key in enumerate(keys):
+        if i % 500 == 0:
+            assert state[key] == f"new{i}", f"{key} missed a write made during the snapshot"
+        elif i % 500 == 1:
+            assert key not in state, f"{key} missed a delete made during the snapshot"
+        else:
+            assert state[key] == value, f"{key} is wrong after the snapshot"
+
+    pipeline([{"key": key, "operation": "DEL"} for key in keys])
+
+# Test value compression on a replica that compresses what it loads
+def test_compression():
+    """Test that compressed values read back unchanged, in full and as stored."""
+    document = json.dumps({"items": [{"id": i, "name": "item", "tags": ["a", "b"]} for i in range(500)]})
+    plain = "compressible " * 2000
+    assert send_command(json.dumps({"key": "doc", "operation": "SET", "value": document})) == "OK"
+    assert send_command(json.dumps({"key": "plain", "operation": "SET", "value": plain})) == "OK"
+
+    with replica_server("-c", "1024") as replica_port:
+        assert wait_for(lambda: server_stats(replica_port).get("master_link_up")), "Replica did not sync"
+
+        for key, value in (("doc", document), ("plain", plain)):
+            for port in (PORT, replica_port):
+                response = send_command_full(f'{{"key": "{key}", "operation": "GET"}}', port)
+                assert json.loads(response) == value, f"GET of {key} returned a different value"
+
+            stored = json.loads(send_command_full(f'{{"key": "{key}", "operation": "GET", "value": "RAW"}}', replica_port))
+            if stored["encoding"] == "lz4":
+                assert stored["length"] == len(value)
+                assert len(base64.b64decode(stored["data"])) < len(value), "Compressed value is not smaller"
+            else:
+                assert stored == {"encoding": "raw", "data": value}
+
+        stats = server_stats(replica_port)
+        if stats["compress_threshold"]:  # Zero when built without LZ4
+            assert stats["compressed_values"] >= 2, "Large values were not compressed"
+            assert stats["compression_ratio"] > 5, f"Poor compression ratio {stats['compression_ratio']}"
+
+# Test the C client library through the network benchmark, which checks every reply
+def test_client_library():
+    """Test blocking, pipelined, batched and event-loop clients of libminiredis."""
+    if not os.path.exists(NETBENCH_PATH):
+        pytest.skip("mini-redis-netbench is not built")
+
+    result = subprocess.run(
+        [NETBENCH_PATH, "-p", str(PORT), "-n", "2000", "-t", "1,3", "-d", "1,50", "-v", "100"],
+        capture_output=True, text=True, timeout=120
+    )
+    assert result.returncode == 0, f"Client library run failed: {result.stderr}"
+    modes = {line.split()[0] for line in result.stdout.splitlines()[1:]}
+    assert modes == {"sync", "pipeline", "batch", "async"}
+
+    value = send_command('{"key": "bench:0000000000000000", "operation": "GET"}')
+    assert json.loads(value) == "v" * 100, "Client library stored a different value"
+
 # Test for potential memory leaks
 def test_memory_leak():
     """Test for potential memory leaks during a large number of operations."""